@@ -0,0 +1,98 @@
+/*
+ * Barrier, latch and wait group test
+ *
+ * A coordinator thread fans out to a number of workers. The workers wait on a
+ * latch until all of them are started, go through several rounds separated by
+ * a barrier, and the coordinator waits for them with a wait group. Exits with a
+ * failure as soon as a check fails.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <barrier.h>
+#include <uthread.h>
+
+#define NWORKERS	100
+#define NROUNDS		3
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	if (!(assert)) {				\
+		printf("ASSERT: " #assert " ... FAIL\n");	\
+		exit(1);				\
+	}						\
+} while(0)
+
+static unsigned int nworkers = NWORKERS;
+
+uthread_barrier_t barrier;
+uthread_latch_t started;
+uthread_waitgroup_t wg;
+unsigned int round_count[NROUNDS], serials;
+
+static void worker(void *arg)
+{
+	int round;
+	(void)arg;
+
+	uthread_latch_count_down(started);
+	uthread_latch_wait(started);
+
+	for (round = 0; round < NROUNDS; round++) {
+		round_count[round]++;
+		if (uthread_barrier_wait(barrier) ==
+		    UTHREAD_BARRIER_SERIAL_THREAD)
+			serials++;
+		/* Everybody is done with this round */
+		TEST_ASSERT(round_count[round] == nworkers);
+	}
+
+	uthread_waitgroup_done(wg);
+}
+
+static void coordinator(void *arg)
+{
+	unsigned int i;
+	(void)arg;
+
+	uthread_waitgroup_add(wg, nworkers);
+	for (i = 0; i < nworkers; i++)
+		uthread_create(worker, NULL);
+
+	uthread_waitgroup_wait(wg);
+	TEST_ASSERT(serials == NROUNDS);
+	TEST_ASSERT(uthread_waitgroup_done(wg) == -1);
+	TEST_ASSERT(uthread_latch_count_down(started) == -1);
+	printf("%u workers went through %d rounds\n", nworkers, NROUNDS);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		nworkers = get_argv(argv[1]);
+
+	barrier = uthread_barrier_create(nworkers);
+	started = uthread_latch_create(nworkers);
+	wg = uthread_waitgroup_create();
+
+	uthread_run(false, coordinator, NULL);
+
+	TEST_ASSERT(uthread_barrier_destroy(barrier) == 0);
+	TEST_ASSERT(uthread_latch_destroy(started) == 0);
+	TEST_ASSERT(uthread_waitgroup_destroy(wg) == 0);
+
+	return 0;
+}
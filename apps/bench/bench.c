@@ -0,0 +1,155 @@
+/*
+ * Microbenchmark suite
+ *
+ * Usage: bench.x [-f json|csv] [-b batches] [suite...]
+ *
+ * Run the given suites ("sched", "queue"), or all of them, and print the time
+ * per operation of each benchmark (mean, percentiles, extremes) in JSON or
+ * CSV, one benchmark per line so that runs can be diffed.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+size_t bench_batches = 200;
+
+static bool csv;
+static bool first_report = true;
+
+uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+void bench_init(struct bench *b, const char *name, unsigned long ops,
+		const char *fmt, ...)
+{
+	va_list ap;
+
+	b->name = name;
+	b->ops = ops;
+	b->n = 0;
+	va_start(ap, fmt);
+	vsnprintf(b->param, sizeof(b->param), fmt, ap);
+	va_end(ap);
+}
+
+void bench_record(struct bench *b, uint64_t start)
+{
+	uint64_t end = bench_now();
+
+	if (b->n < BENCH_MAX_BATCHES)
+		b->ns[b->n++] = end - start;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Per-operation time of the batch at percentile @p of sorted samples */
+static double percentile(struct bench *b, double p)
+{
+	size_t i = (size_t)(p / 100 * (b->n - 1) + 0.5);
+
+	return (double)b->ns[i] / b->ops;
+}
+
+void bench_report(struct bench *b)
+{
+	double mean = 0;
+	size_t i;
+
+	if (b->n == 0)
+		return;
+
+	qsort(b->ns, b->n, sizeof(b->ns[0]), cmp_u64);
+	for (i = 0; i < b->n; i++)
+		mean += b->ns[i];
+	mean /= (double)b->n * b->ops;
+
+	if (csv) {
+		if (first_report)
+			printf("bench,param,ops,mean_ns,p50_ns,p90_ns,p99_ns,"
+			       "min_ns,max_ns\n");
+		printf("%s,%s,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+		       b->name, b->param, b->ops * b->n, mean,
+		       percentile(b, 50), percentile(b, 90), percentile(b, 99),
+		       percentile(b, 0), percentile(b, 100));
+	} else {
+		printf("%s{\"bench\": \"%s\", \"param\": \"%s\", \"ops\": %lu, "
+		       "\"mean_ns\": %.1f, \"p50_ns\": %.1f, \"p90_ns\": %.1f, "
+		       "\"p99_ns\": %.1f, \"min_ns\": %.1f, \"max_ns\": %.1f}",
+		       first_report ? "[\n" : ",\n", b->name, b->param,
+		       b->ops * b->n, mean, percentile(b, 50),
+		       percentile(b, 90), percentile(b, 99), percentile(b, 0),
+		       percentile(b, 100));
+	}
+	first_report = false;
+	fflush(stdout);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-f json|csv] [-b batches] [sched|queue...]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	bool all = true, sched = false, queue = false;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "f:b:")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (strcmp(optarg, "csv") == 0)
+				csv = true;
+			else if (strcmp(optarg, "json") != 0)
+				usage(argv[0]);
+			break;
+		case 'b':
+			bench_batches = strtoul(optarg, NULL, 0);
+			if (bench_batches == 0 ||
+			    bench_batches > BENCH_MAX_BATCHES)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	for (i = optind; i < argc; i++) {
+		all = false;
+		if (strcmp(argv[i], "sched") == 0)
+			sched = true;
+		else if (strcmp(argv[i], "queue") == 0)
+			queue = true;
+		else
+			usage(argv[0]);
+	}
+
+	if (all || sched)
+		bench_sched();
+	if (all || queue)
+		bench_queue();
+
+	if (!csv && !first_report)
+		printf("\n]\n");
+
+	return 0;
+}
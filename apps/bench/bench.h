@@ -0,0 +1,71 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Microbenchmark harness
+ *
+ * A benchmark runs its operation by batches and records the duration of each
+ * batch. Percentiles are computed over the per-operation time of the batches,
+ * so that timing an operation doesn't cost more than the operation itself.
+ */
+
+/* Maximum number of batches of a benchmark */
+#define BENCH_MAX_BATCHES 10000
+
+/*
+ * struct bench - Benchmark samples
+ * @name: Name of benchmark
+ * @param: Parameters of this run, e.g. "threads=8"
+ * @ops: Number of operations per batch
+ * @n: Number of recorded batches
+ * @ns: Duration of each batch, in nanoseconds
+ */
+struct bench {
+	const char *name;
+	char param[64];
+	unsigned long ops;
+	size_t n;
+	uint64_t ns[BENCH_MAX_BATCHES];
+};
+
+/* Number of batches to run, set from the command line */
+extern size_t bench_batches;
+
+/*
+ * bench_now - Get current time
+ *
+ * Return: Current time of the monotonic clock, in nanoseconds
+ */
+uint64_t bench_now(void);
+
+/*
+ * bench_init - Start a benchmark run
+ * @b: Benchmark samples
+ * @name: Name of benchmark
+ * @ops: Number of operations per batch
+ * @fmt: printf format of parameters of this run
+ */
+void bench_init(struct bench *b, const char *name, unsigned long ops,
+		const char *fmt, ...);
+
+/*
+ * bench_record - Record duration of a batch
+ * @b: Benchmark samples
+ * @start: Start time of the batch, as returned by bench_now()
+ */
+void bench_record(struct bench *b, uint64_t start);
+
+/*
+ * bench_report - Print per-operation statistics of a benchmark run
+ * @b: Benchmark samples
+ */
+void bench_report(struct bench *b);
+
+/* Benchmark suites */
+void bench_sched(void);
+void bench_queue(void);
+
+#endif /* _BENCH_H */
@@ -0,0 +1,103 @@
+/*
+ * Queue benchmarks
+ *
+ * - enqueue_dequeue: enqueue an item and dequeue another one, in a queue of a
+ *   given size
+ * - delete: delete an item from a queue of a given size and enqueue it back
+ *
+ * Each benchmark runs with linked list, ring buffer and indexed queues, on
+ * items the size of a TCB. Indexed queues also run on consecutive bytes, the
+ * worst alignment for hashing item addresses.
+ */
+
+#include <stdlib.h>
+
+#include <queue.h>
+
+#include "bench.h"
+
+#define QUEUE_OPS	1000
+#define DELETE_OPS	16
+#define MAX_SIZE	65536
+
+/* Stand-in for a TCB, like the items queued by the scheduler */
+#define ITEM_SIZE	256
+
+enum { DEFAULT, RING, INDEXED };
+
+static const char *kinds[] = { "default", "ring", "indexed" };
+
+static struct bench b;
+
+static queue_t create(int kind, int size)
+{
+	switch (kind) {
+	case RING:
+		return queue_create_ex(size);
+	case INDEXED:
+		return queue_create_indexed();
+	default:
+		return queue_create();
+	}
+}
+
+/* Run benchmarks on @size items spaced by @stride bytes from @items */
+static void bench_one(int kind, int size, char *items, size_t stride)
+{
+	queue_t q = create(kind, size);
+	const char *suffix = stride == ITEM_SIZE ? "" : " stride=1";
+	void *data;
+	size_t i;
+	int k, j = 0;
+
+	for (k = 0; k < size; k++)
+		queue_enqueue(q, &items[k * stride]);
+
+	bench_init(&b, "enqueue_dequeue", QUEUE_OPS, "%s size=%d%s",
+		   kinds[kind], size, suffix);
+	for (i = 0; i < bench_batches; i++) {
+		uint64_t start = bench_now();
+
+		for (k = 0; k < QUEUE_OPS; k++) {
+			queue_dequeue(q, &data);
+			queue_enqueue(q, data);
+		}
+		bench_record(&b, start);
+	}
+	bench_report(&b);
+
+	/* Delete items from all positions in turn */
+	bench_init(&b, "delete", DELETE_OPS, "%s size=%d%s", kinds[kind], size,
+		   suffix);
+	for (i = 0; i < bench_batches; i++) {
+		uint64_t start = bench_now();
+
+		for (k = 0; k < DELETE_OPS; k++) {
+			queue_delete(q, &items[j * stride]);
+			queue_enqueue(q, &items[j * stride]);
+			j = (j + 7) % size;
+		}
+		bench_record(&b, start);
+	}
+	bench_report(&b);
+
+	while (queue_dequeue(q, &data) == 0)
+		;
+	queue_destroy(q);
+}
+
+void bench_queue(void)
+{
+	int sizes[] = { 16, 1024, 65536 };
+	char *items = malloc((size_t)MAX_SIZE * ITEM_SIZE);
+	size_t i;
+	int kind;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		for (kind = DEFAULT; kind <= INDEXED; kind++)
+			bench_one(kind, sizes[i], items, ITEM_SIZE);
+		bench_one(INDEXED, sizes[i], items, 1);
+	}
+
+	free(items);
+}
@@ -0,0 +1,189 @@
+/*
+ * Scheduler benchmarks
+ *
+ * - yield: context switch between N threads yielding in turn (the idle thread
+ *   takes part in each round)
+ * - create_exit: creation of a thread which exits right away, including its
+ *   first run and its destruction
+ * - sem_handoff: round trip between two threads through two semaphores
+ * - preempt: CPU-bound work shared by two threads, without and with
+ *   preemption, to measure the cost of preemption
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#include "bench.h"
+
+/* Operations per batch */
+#define YIELD_OPS	1000
+#define CREATE_OPS	100
+#define SEM_OPS		1000
+
+/* Work units done by each thread of the preemption benchmark */
+#define WORK_UNITS	20000
+
+static struct bench b;
+static volatile bool stop;
+static int nthreads;
+
+static void yielder(void *arg)
+{
+	(void)arg;
+	while (!stop)
+		uthread_yield();
+}
+
+static void yield_main(void *arg)
+{
+	size_t i;
+	int k;
+
+	(void)arg;
+	stop = false;
+	for (k = 1; k < nthreads; k++)
+		uthread_create(yielder, NULL);
+	for (i = 0; i < bench_batches; i++) {
+		uint64_t start = bench_now();
+
+		for (k = 0; k < YIELD_OPS; k++)
+			uthread_yield();
+		bench_record(&b, start);
+	}
+	stop = true;
+}
+
+static void nop(void *arg)
+{
+	(void)arg;
+}
+
+static void create_main(void *arg)
+{
+	size_t i;
+	int k;
+
+	(void)arg;
+	for (i = 0; i < bench_batches; i++) {
+		uint64_t start = bench_now();
+
+		for (k = 0; k < CREATE_OPS; k++)
+			uthread_create(nop, NULL);
+		/* Let the new threads run and exit */
+		uthread_yield();
+		bench_record(&b, start);
+	}
+}
+
+static sem_t ping, pong;
+
+static void ponger(void *arg)
+{
+	(void)arg;
+	while (1) {
+		sem_down(ping);
+		if (stop)
+			break;
+		sem_up(pong);
+	}
+}
+
+static void sem_main(void *arg)
+{
+	size_t i;
+	int k;
+
+	(void)arg;
+	stop = false;
+	uthread_create(ponger, NULL);
+	for (i = 0; i < bench_batches; i++) {
+		uint64_t start = bench_now();
+
+		for (k = 0; k < SEM_OPS; k++) {
+			sem_up(ping);
+			sem_down(pong);
+		}
+		bench_record(&b, start);
+	}
+	stop = true;
+	sem_up(ping);
+}
+
+/* Some CPU-bound work the compiler can't optimize out */
+static volatile uint32_t work_sink;
+
+static void worker(void *arg)
+{
+	uint32_t x = (uintptr_t)arg;
+	int i, j;
+
+	for (i = 0; i < WORK_UNITS; i++)
+		for (j = 0; j < 1000; j++)
+			x = x * 1664525 + 1013904223;
+	work_sink = x;
+}
+
+static void preempt_main(void *arg)
+{
+	(void)arg;
+	uthread_create(worker, (void *)1);
+	uthread_create(worker, (void *)2);
+}
+
+static void bench_preempt(bool preempt, unsigned long quantum_us)
+{
+	struct uthread_run_opts opts = {
+		.preempt = preempt,
+		.quantum_us = quantum_us,
+		.clock = UTHREAD_CLOCK_VIRTUAL,
+	};
+	size_t i, runs = bench_batches / 10 + 1;
+
+	if (preempt)
+		bench_init(&b, "preempt", 2 * WORK_UNITS, "quantum_us=%lu",
+			   quantum_us);
+	else
+		bench_init(&b, "preempt", 2 * WORK_UNITS, "off");
+	for (i = 0; i < runs; i++) {
+		uint64_t start = bench_now();
+
+		uthread_run_ex(&opts, preempt_main, NULL);
+		bench_record(&b, start);
+	}
+	bench_report(&b);
+}
+
+void bench_sched(void)
+{
+	int threads[] = { 2, 8, 64, 512 };
+	size_t i;
+
+	for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		nthreads = threads[i];
+		/* Each round switches to every thread and to the idle thread */
+		bench_init(&b, "yield", YIELD_OPS * (nthreads + 1),
+			   "threads=%d", nthreads);
+		uthread_run(false, yield_main, NULL);
+		bench_report(&b);
+	}
+
+	bench_init(&b, "create_exit", CREATE_OPS, "");
+	uthread_run(false, create_main, NULL);
+	bench_report(&b);
+
+	ping = sem_create(0);
+	pong = sem_create(0);
+	bench_init(&b, "sem_handoff", SEM_OPS, "");
+	uthread_run(false, sem_main, NULL);
+	bench_report(&b);
+	sem_destroy(ping);
+	sem_destroy(pong);
+
+	bench_preempt(false, 0);
+	bench_preempt(true, 10000);
+	bench_preempt(true, 1000);
+	bench_preempt(true, 100);
+}
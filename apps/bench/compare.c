@@ -0,0 +1,504 @@
+/*
+ * Comparison benchmarks
+ *
+ * Usage: compare.x [-f table|csv] [-m max_mib] [workload...]
+ *
+ * Run the same workloads ("pipeline", "buffer", "fanout", or all of them) with
+ * libuthread, with pthreads, and with a bare swapcontext() scheduler, at
+ * increasing thread counts, and print side by side the throughput, the
+ * median and 99th percentile latency of an item, and the peak memory usage.
+ *
+ * - pipeline: chain of threads passing tokens through one-slot buffers, as in
+ *   sem_prime; latency of a token from source to sink
+ * - buffer: producers and consumers sharing a bounded buffer; latency of an
+ *   item from producer to consumer
+ * - fanout: threads all blocked on a semaphore, released by the main thread
+ *   which then waits for each of them; latency of a thread from its release
+ *   to its run
+ *
+ * Each run happens in its own child process, so that its peak resident set
+ * size can be read once it exits. With -m, the address space of a run is
+ * limited to the given size. Once a backend fails at a thread count, for lack
+ * of memory or threads, it is not run at the higher counts.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "compare.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+/* Number of token handoffs between two stages of the pipeline */
+#define PIPELINE_HANDOFFS 200000UL
+
+/* Size of the bounded buffer, and number of items going through it */
+#define BUFFER_SLOTS 64
+#define BUFFER_ITEMS 200000UL
+
+struct workload {
+	const char *name;
+	unsigned long sizes[4];	/* Increasing, 0 after the last one */
+
+	/* Prepare a run of @size, return number of threads and of items */
+	void (*setup)(unsigned long size, unsigned long *threads,
+		      unsigned long *items);
+
+	/* First thread of a run */
+	void (*main)(void *arg);
+};
+
+/* Outcome of a run, sent by the child process to the parent */
+struct result {
+	unsigned long items;
+	double seconds;
+	uint64_t p50_ns;
+	uint64_t p99_ns;
+};
+
+static const struct compare_backend *be;
+
+/* Item latencies of current run */
+static uint64_t *lat;
+static unsigned long nlat, maxlat;
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void record(uint64_t start)
+{
+	uint64_t ns = now() - start;
+	unsigned long i = __atomic_fetch_add(&nlat, 1, __ATOMIC_RELAXED);
+
+	if (i < maxlat)
+		lat[i] = ns;
+}
+
+static void *sem_create_or_die(unsigned int count)
+{
+	void *sem = be->sem_create(count);
+
+	if (sem == NULL)
+		_exit(2);
+	return sem;
+}
+
+static void spawn_or_die(void (*func)(void *arg), void *arg)
+{
+	if (be->spawn(func, arg))
+		_exit(2);
+}
+
+/*
+ * pipeline
+ */
+
+struct link {
+	void *empty;
+	void *full;
+	uint64_t stamp;
+};
+
+static struct link *links;
+static unsigned long stages, tokens;
+
+static void link_put(struct link *l, uint64_t stamp)
+{
+	be->down(l->empty);
+	l->stamp = stamp;
+	be->up(l->full);
+}
+
+static uint64_t link_get(struct link *l)
+{
+	uint64_t stamp;
+
+	be->down(l->full);
+	stamp = l->stamp;
+	be->up(l->empty);
+
+	return stamp;
+}
+
+static void pipeline_stage(void *arg)
+{
+	struct link *in = arg;
+	unsigned long i;
+
+	for (i = 0; i < tokens; i++)
+		link_put(in + 1, link_get(in));
+}
+
+static void pipeline_sink(void *arg)
+{
+	unsigned long i;
+
+	for (i = 0; i < tokens; i++)
+		record(link_get(arg));
+}
+
+static void pipeline_setup(unsigned long size, unsigned long *threads,
+			   unsigned long *items)
+{
+	stages = size;
+	tokens = PIPELINE_HANDOFFS / stages;
+	if (tokens < 20)
+		tokens = 20;
+	*threads = stages + 2;
+	*items = tokens;
+}
+
+static void pipeline_main(void *arg)
+{
+	unsigned long i;
+
+	(void)arg;
+
+	links = malloc((stages + 1) * sizeof(*links));
+	if (links == NULL)
+		_exit(2);
+	for (i = 0; i <= stages; i++) {
+		links[i].empty = sem_create_or_die(1);
+		links[i].full = sem_create_or_die(0);
+	}
+	for (i = 0; i < stages; i++)
+		spawn_or_die(pipeline_stage, &links[i]);
+	spawn_or_die(pipeline_sink, &links[stages]);
+
+	/* Act as source */
+	for (i = 0; i < tokens; i++)
+		link_put(&links[0], now());
+}
+
+/*
+ * buffer
+ */
+
+static struct {
+	void *empty;
+	void *full;
+	void *lock;
+	unsigned long head, tail;
+	uint64_t slots[BUFFER_SLOTS];
+} buf;
+static unsigned long pairs, per_producer;
+
+static void buffer_producer(void *arg)
+{
+	unsigned long i;
+
+	(void)arg;
+	for (i = 0; i < per_producer; i++) {
+		be->down(buf.empty);
+		be->down(buf.lock);
+		buf.slots[buf.tail++ % BUFFER_SLOTS] = now();
+		be->up(buf.lock);
+		be->up(buf.full);
+	}
+}
+
+static void buffer_consumer(void *arg)
+{
+	uint64_t stamp;
+	unsigned long i;
+
+	(void)arg;
+	for (i = 0; i < per_producer; i++) {
+		be->down(buf.full);
+		be->down(buf.lock);
+		stamp = buf.slots[buf.head++ % BUFFER_SLOTS];
+		be->up(buf.lock);
+		be->up(buf.empty);
+		record(stamp);
+	}
+}
+
+static void buffer_setup(unsigned long size, unsigned long *threads,
+			 unsigned long *items)
+{
+	pairs = size;
+	per_producer = BUFFER_ITEMS / pairs;
+	*threads = 2 * pairs + 1;
+	*items = per_producer * pairs;
+}
+
+static void buffer_main(void *arg)
+{
+	unsigned long i;
+
+	(void)arg;
+
+	buf.empty = sem_create_or_die(BUFFER_SLOTS);
+	buf.full = sem_create_or_die(0);
+	buf.lock = sem_create_or_die(1);
+	for (i = 0; i < pairs; i++) {
+		spawn_or_die(buffer_consumer, NULL);
+		spawn_or_die(buffer_producer, NULL);
+	}
+}
+
+/*
+ * fanout
+ */
+
+static void *go, *done;
+static unsigned long workers;
+static uint64_t release;
+
+static void fanout_worker(void *arg)
+{
+	(void)arg;
+	be->down(go);
+	record(release);
+	be->up(done);
+}
+
+static void fanout_setup(unsigned long size, unsigned long *threads,
+			 unsigned long *items)
+{
+	workers = size;
+	*threads = workers + 1;
+	*items = workers;
+}
+
+static void fanout_main(void *arg)
+{
+	unsigned long i;
+
+	(void)arg;
+
+	go = sem_create_or_die(0);
+	done = sem_create_or_die(0);
+	for (i = 0; i < workers; i++)
+		spawn_or_die(fanout_worker, NULL);
+
+	release = now();
+	for (i = 0; i < workers; i++)
+		be->up(go);
+	for (i = 0; i < workers; i++)
+		be->down(done);
+}
+
+static const struct workload workloads[] = {
+	{ "pipeline", { 10, 100, 1000, 10000 }, pipeline_setup, pipeline_main },
+	{ "buffer", { 1, 16, 256, 4096 }, buffer_setup, buffer_main },
+	{ "fanout", { 1000, 10000, 100000 }, fanout_setup, fanout_main },
+};
+
+static const struct compare_backend *backends[] = {
+	&compare_uthread,
+	&compare_pthread,
+	&compare_ucontext,
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Body of the child process of a run */
+static void child(const struct workload *w, unsigned long items, int fd)
+{
+	struct result res;
+	uint64_t start;
+	size_t n;
+
+	maxlat = items;
+	lat = malloc(maxlat * sizeof(*lat));
+	if (lat == NULL)
+		_exit(2);
+
+	start = now();
+	if (be->run(w->main, NULL))
+		_exit(2);
+	res.seconds = (double)(now() - start) / NSEC_PER_SEC;
+
+	n = nlat < maxlat ? nlat : maxlat;
+	if (n == 0)
+		_exit(2);
+	qsort(lat, n, sizeof(*lat), cmp_u64);
+	res.items = n;
+	res.p50_ns = lat[(n - 1) / 2];
+	res.p99_ns = lat[(n - 1) * 99 / 100];
+
+	if (write(fd, &res, sizeof(res)) != sizeof(res))
+		_exit(2);
+	_exit(0);
+}
+
+/*
+ * run - Run workload in child process
+ *
+ * Return: 0 and outcome of the run in @res and @maxrss_kb, -1 if the run
+ * failed
+ */
+static int run(const struct workload *w, unsigned long items,
+	       unsigned long max_mib, struct result *res, long *maxrss_kb)
+{
+	struct rusage ru;
+	int fd[2], status;
+	ssize_t len;
+	pid_t pid;
+
+	if (pipe(fd))
+		return -1;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		close(fd[0]);
+		close(fd[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		close(fd[0]);
+		if (max_mib) {
+			struct rlimit rl = {
+				.rlim_cur = max_mib << 20,
+				.rlim_max = max_mib << 20,
+			};
+
+			setrlimit(RLIMIT_AS, &rl);
+		}
+		child(w, items, fd[1]);
+	}
+
+	close(fd[1]);
+	len = read(fd[0], res, sizeof(*res));
+	close(fd[0]);
+	if (wait4(pid, &status, 0, &ru) != pid)
+		return -1;
+	*maxrss_kb = ru.ru_maxrss;
+
+	if (len != sizeof(*res) || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != 0)
+		return -1;
+
+	return 0;
+}
+
+static bool csv;
+
+static void report_header(void)
+{
+	if (csv)
+		printf("workload,threads,backend,items_per_sec,p50_ns,p99_ns,"
+		       "maxrss_kb\n");
+	else
+		printf("%-9s %8s  %-9s %12s %12s %12s %10s\n", "workload",
+		       "threads", "backend", "items/s", "p50_us", "p99_us",
+		       "maxrss_kb");
+}
+
+static void report(const struct workload *w, unsigned long threads,
+		   const struct result *res, long maxrss_kb)
+{
+	double rate = res ? res->items / res->seconds : 0;
+
+	if (csv) {
+		if (res)
+			printf("%s,%lu,%s,%.0f,%llu,%llu,%ld\n", w->name,
+			       threads, be->name, rate,
+			       (unsigned long long)res->p50_ns,
+			       (unsigned long long)res->p99_ns, maxrss_kb);
+		else
+			printf("%s,%lu,%s,,,,\n", w->name, threads, be->name);
+	} else {
+		if (res)
+			printf("%-9s %8lu  %-9s %12.0f %12.1f %12.1f %10ld\n",
+			       w->name, threads, be->name, rate,
+			       res->p50_ns / 1000.0, res->p99_ns / 1000.0,
+			       maxrss_kb);
+		else
+			printf("%-9s %8lu  %-9s %12s\n", w->name, threads,
+			       be->name, "failed");
+	}
+	fflush(stdout);
+}
+
+static void compare(const struct workload *w, unsigned long max_mib)
+{
+	bool failed[ARRAY_SIZE(backends)] = { false };
+	unsigned long threads, items;
+	struct result res;
+	long maxrss_kb;
+	size_t i, j;
+
+	for (i = 0; i < ARRAY_SIZE(w->sizes) && w->sizes[i]; i++) {
+		w->setup(w->sizes[i], &threads, &items);
+		for (j = 0; j < ARRAY_SIZE(backends); j++) {
+			if (failed[j])
+				continue;
+			be = backends[j];
+			if (run(w, items, max_mib, &res, &maxrss_kb)) {
+				failed[j] = true;
+				report(w, threads, NULL, 0);
+			} else {
+				report(w, threads, &res, maxrss_kb);
+			}
+		}
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-f table|csv] [-m max_mib] "
+		"[pipeline|buffer|fanout...]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	bool selected[ARRAY_SIZE(workloads)] = { false }, all = true;
+	unsigned long max_mib = 0;
+	int opt, i;
+	size_t j;
+
+	while ((opt = getopt(argc, argv, "f:m:")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (strcmp(optarg, "csv") == 0)
+				csv = true;
+			else if (strcmp(optarg, "table") != 0)
+				usage(argv[0]);
+			break;
+		case 'm':
+			max_mib = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	for (i = optind; i < argc; i++) {
+		all = false;
+		for (j = 0; j < ARRAY_SIZE(workloads); j++)
+			if (strcmp(argv[i], workloads[j].name) == 0)
+				break;
+		if (j == ARRAY_SIZE(workloads))
+			usage(argv[0]);
+		selected[j] = true;
+	}
+
+	report_header();
+	for (j = 0; j < ARRAY_SIZE(workloads); j++)
+		if (all || selected[j])
+			compare(&workloads[j], max_mib);
+
+	return 0;
+}
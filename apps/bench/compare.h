@@ -0,0 +1,30 @@
+#ifndef _COMPARE_H
+#define _COMPARE_H
+
+/*
+ * Threading backend of the comparison benchmarks
+ *
+ * The workloads are written once against this interface, and run with each
+ * backend in turn.
+ */
+struct compare_backend {
+	const char *name;
+
+	/* Run @main as a first thread, return once all threads finished */
+	int (*run)(void (*main)(void *arg), void *arg);
+
+	/* Start a new thread */
+	int (*spawn)(void (*func)(void *arg), void *arg);
+
+	/* Counting semaphores */
+	void *(*sem_create)(unsigned int count);
+	void (*sem_destroy)(void *sem);
+	void (*down)(void *sem);
+	void (*up)(void *sem);
+};
+
+extern const struct compare_backend compare_uthread;
+extern const struct compare_backend compare_pthread;
+extern const struct compare_backend compare_ucontext;
+
+#endif /* _COMPARE_H */
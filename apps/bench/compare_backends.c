@@ -0,0 +1,345 @@
+/*
+ * Backends of the comparison benchmarks
+ *
+ * - uthread: this library, without preemption
+ * - pthread: kernel threads, with semaphores made of a mutex and a condition
+ *   variable
+ * - ucontext: a minimal cooperative scheduler switching directly between
+ *   threads with swapcontext(), as a floor for any ucontext-based library
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#include "compare.h"
+
+/* Stack size of pthread and ucontext threads, same as libuthread */
+#define COMPARE_STACK_SIZE 32768
+
+/*
+ * uthread
+ */
+
+static int ut_run(void (*main)(void *arg), void *arg)
+{
+	return uthread_run(false, main, arg);
+}
+
+static void *ut_sem_create(unsigned int count)
+{
+	return sem_create(count);
+}
+
+static void ut_sem_destroy(void *sem)
+{
+	sem_destroy(sem);
+}
+
+static void ut_down(void *sem)
+{
+	sem_down(sem);
+}
+
+static void ut_up(void *sem)
+{
+	sem_up(sem);
+}
+
+const struct compare_backend compare_uthread = {
+	.name = "uthread",
+	.run = ut_run,
+	.spawn = uthread_create,
+	.sem_create = ut_sem_create,
+	.sem_destroy = ut_sem_destroy,
+	.down = ut_down,
+	.up = ut_up,
+};
+
+/*
+ * pthread
+ */
+
+struct pt_sem {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned int count;
+};
+
+struct pt_start {
+	void (*func)(void *arg);
+	void *arg;
+};
+
+/* Live threads, to wait for in pt_run() */
+static struct pt_sem pt_live = {
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0
+};
+
+static void *pt_start(void *data)
+{
+	struct pt_start start = *(struct pt_start *)data;
+
+	free(data);
+	start.func(start.arg);
+
+	pthread_mutex_lock(&pt_live.lock);
+	if (--pt_live.count == 0)
+		pthread_cond_signal(&pt_live.cond);
+	pthread_mutex_unlock(&pt_live.lock);
+
+	return NULL;
+}
+
+static int pt_spawn(void (*func)(void *arg), void *arg)
+{
+	struct pt_start *start = malloc(sizeof(*start));
+	pthread_attr_t attr;
+	pthread_t thread;
+	int ret;
+
+	if (start == NULL)
+		return -1;
+	start->func = func;
+	start->arg = arg;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, COMPARE_STACK_SIZE);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	pthread_mutex_lock(&pt_live.lock);
+	pt_live.count++;
+	pthread_mutex_unlock(&pt_live.lock);
+
+	ret = pthread_create(&thread, &attr, pt_start, start);
+	pthread_attr_destroy(&attr);
+	if (ret) {
+		pthread_mutex_lock(&pt_live.lock);
+		pt_live.count--;
+		pthread_mutex_unlock(&pt_live.lock);
+		free(start);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int pt_run(void (*main)(void *arg), void *arg)
+{
+	if (pt_spawn(main, arg))
+		return -1;
+
+	pthread_mutex_lock(&pt_live.lock);
+	while (pt_live.count > 0)
+		pthread_cond_wait(&pt_live.cond, &pt_live.lock);
+	pthread_mutex_unlock(&pt_live.lock);
+
+	return 0;
+}
+
+static void *pt_sem_create(unsigned int count)
+{
+	struct pt_sem *sem = malloc(sizeof(*sem));
+
+	if (sem == NULL)
+		return NULL;
+	pthread_mutex_init(&sem->lock, NULL);
+	pthread_cond_init(&sem->cond, NULL);
+	sem->count = count;
+
+	return sem;
+}
+
+static void pt_sem_destroy(void *data)
+{
+	struct pt_sem *sem = data;
+
+	pthread_mutex_destroy(&sem->lock);
+	pthread_cond_destroy(&sem->cond);
+	free(sem);
+}
+
+static void pt_down(void *data)
+{
+	struct pt_sem *sem = data;
+
+	pthread_mutex_lock(&sem->lock);
+	while (sem->count == 0)
+		pthread_cond_wait(&sem->cond, &sem->lock);
+	sem->count--;
+	pthread_mutex_unlock(&sem->lock);
+}
+
+static void pt_up(void *data)
+{
+	struct pt_sem *sem = data;
+
+	pthread_mutex_lock(&sem->lock);
+	sem->count++;
+	pthread_cond_signal(&sem->cond);
+	pthread_mutex_unlock(&sem->lock);
+}
+
+const struct compare_backend compare_pthread = {
+	.name = "pthread",
+	.run = pt_run,
+	.spawn = pt_spawn,
+	.sem_create = pt_sem_create,
+	.sem_destroy = pt_sem_destroy,
+	.down = pt_down,
+	.up = pt_up,
+};
+
+/*
+ * ucontext
+ *
+ * Threads switch directly to the next ready thread. The scheduler context only
+ * runs when a thread returns (to free it) or when no thread is ready.
+ */
+
+struct uc_thread {
+	ucontext_t ctx;
+	void (*func)(void *arg);
+	void *arg;
+	struct uc_thread *next;
+};
+
+struct uc_list {
+	struct uc_thread *head, *tail;
+};
+
+struct uc_sem {
+	unsigned int count;
+	struct uc_list waiters;
+};
+
+static ucontext_t uc_sched;
+static struct uc_list uc_ready;
+static struct uc_thread *uc_current;
+
+static void uc_push(struct uc_list *list, struct uc_thread *t)
+{
+	t->next = NULL;
+	if (list->tail)
+		list->tail->next = t;
+	else
+		list->head = t;
+	list->tail = t;
+}
+
+static struct uc_thread *uc_pop(struct uc_list *list)
+{
+	struct uc_thread *t = list->head;
+
+	if (t) {
+		list->head = t->next;
+		if (list->head == NULL)
+			list->tail = NULL;
+	}
+
+	return t;
+}
+
+static void uc_trampoline(void)
+{
+	uc_current->func(uc_current->arg);
+	/* Return to the scheduler through uc_link */
+}
+
+static int uc_spawn(void (*func)(void *arg), void *arg)
+{
+	struct uc_thread *t = malloc(sizeof(*t) + COMPARE_STACK_SIZE);
+
+	if (t == NULL)
+		return -1;
+	getcontext(&t->ctx);
+	t->ctx.uc_stack.ss_sp = t + 1;
+	t->ctx.uc_stack.ss_size = COMPARE_STACK_SIZE;
+	t->ctx.uc_link = &uc_sched;
+	makecontext(&t->ctx, uc_trampoline, 0);
+	t->func = func;
+	t->arg = arg;
+	uc_push(&uc_ready, t);
+
+	return 0;
+}
+
+static int uc_run(void (*main)(void *arg), void *arg)
+{
+	if (uc_spawn(main, arg))
+		return -1;
+
+	/*
+	 * Back here when a thread returns, or when every thread is blocked in
+	 * which case there is no current thread to free
+	 */
+	while ((uc_current = uc_pop(&uc_ready)) != NULL) {
+		swapcontext(&uc_sched, &uc_current->ctx);
+		free(uc_current);
+	}
+
+	return 0;
+}
+
+static void *uc_sem_create(unsigned int count)
+{
+	struct uc_sem *sem = calloc(1, sizeof(*sem));
+
+	if (sem)
+		sem->count = count;
+
+	return sem;
+}
+
+static void uc_sem_destroy(void *sem)
+{
+	free(sem);
+}
+
+static void uc_down(void *data)
+{
+	struct uc_sem *sem = data;
+	struct uc_thread *self = uc_current, *next;
+
+	if (sem->count > 0) {
+		sem->count--;
+		return;
+	}
+
+	/* The resource is handed over directly by uc_up() */
+	uc_push(&sem->waiters, self);
+	next = uc_pop(&uc_ready);
+	if (next == NULL) {
+		/* Deadlock: give up on this thread */
+		uc_current = NULL;
+		swapcontext(&self->ctx, &uc_sched);
+		return;
+	}
+	uc_current = next;
+	swapcontext(&self->ctx, &next->ctx);
+}
+
+static void uc_up(void *data)
+{
+	struct uc_sem *sem = data;
+	struct uc_thread *t = uc_pop(&sem->waiters);
+
+	if (t)
+		uc_push(&uc_ready, t);
+	else
+		sem->count++;
+}
+
+const struct compare_backend compare_ucontext = {
+	.name = "ucontext",
+	.run = uc_run,
+	.spawn = uc_spawn,
+	.sem_create = uc_sem_create,
+	.sem_destroy = uc_sem_destroy,
+	.down = uc_down,
+	.up = uc_up,
+};
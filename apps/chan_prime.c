@@ -0,0 +1,103 @@
+/*
+ * Sieve test for finding prime numbers, with channels
+ *
+ * Same pipeline as sem_prime, but the stages are connected with unbuffered
+ * channels instead of hand-made semaphore channels. A producer thread (source)
+ * sends numbers into the pipeline, a consumer thread (sink) gets prime numbers
+ * from the end of the pipeline. A filtering thread is added to the pipeline
+ * each time a new prime number is found, and filters out subsequent numbers
+ * that are multiples of that prime. Closing a channel marks completion.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chan.h>
+#include <uthread.h>
+
+#define MAXPRIME 1000
+
+struct filter {
+	uthread_chan_t left;
+	uthread_chan_t right;
+	int prime;
+};
+
+static unsigned int max = MAXPRIME;
+
+/* Producer thread: produces all numbers, from 2 to max */
+static void source(void *arg)
+{
+	uthread_chan_t c = (uthread_chan_t) arg;
+	int i;
+
+	for (i = 2; i <= (int)max; i++)
+		uthread_chan_send(c, &i);
+
+	/* mark completion */
+	uthread_chan_close(c);
+}
+
+/* Filter thread */
+static void filter(void *arg)
+{
+	struct filter *f = (struct filter*) arg;
+	int value;
+
+	while (uthread_chan_recv(f->left, &value) == 0) {
+		if (value % f->prime != 0)
+			uthread_chan_send(f->right, &value);
+	}
+	uthread_chan_close(f->right);
+
+	uthread_chan_destroy(f->left);
+	free(f);
+}
+
+/* Consumer thread */
+static void sink(void *arg)
+{
+	uthread_chan_t c;
+	int value;
+	(void)arg;
+
+	c = uthread_chan_create(sizeof(int), 0);
+	uthread_create(source, c);
+
+	while (uthread_chan_recv(c, &value) == 0) {
+		struct filter *f;
+
+		printf("%d is prime.\n", value);
+
+		f = malloc(sizeof(*f));
+		f->left = c;
+		f->prime = value;
+		f->right = c = uthread_chan_create(sizeof(int), 0);
+
+		uthread_create(filter, f);
+	}
+
+	uthread_chan_destroy(c);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		max = get_argv(argv[1]);
+
+	uthread_run(false, sink, NULL);
+
+	return 0;
+}
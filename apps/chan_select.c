@@ -0,0 +1,98 @@
+/*
+ * Channel and select test
+ *
+ * Checks buffered and unbuffered channels, close semantics and selection over
+ * several channels. Exits with a failure as soon as a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chan.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+uthread_chan_t buffered, unbuffered, done;
+
+static void producer(void *arg)
+{
+	int i, ret;
+	(void)arg;
+
+	/* Fills the buffer without blocking, then blocks on the 5th message */
+	for (i = 0; i < 5; i++)
+		uthread_chan_send(buffered, &i);
+	uthread_chan_close(buffered);
+
+	/* Rendezvous with the consumer */
+	i = 42;
+	uthread_chan_send(unbuffered, &i);
+
+	/* Blocked until the consumer closes the channel */
+	ret = uthread_chan_send(unbuffered, &i);
+	TEST_ASSERT(ret == -1);
+	uthread_chan_send(done, &i);
+}
+
+static void consumer(void *arg)
+{
+	struct uthread_select_case cases[2];
+	int i, value, other;
+	(void)arg;
+
+	uthread_create(producer, NULL);
+
+	/* Nothing to receive yet */
+	cases[0] = (struct uthread_select_case) {
+		.chan = unbuffered, .op = UTHREAD_CHAN_RECV, .elem = &value };
+	cases[1] = (struct uthread_select_case) {
+		.chan = done, .op = UTHREAD_CHAN_RECV, .elem = &other };
+	TEST_ASSERT(uthread_select(cases, 2, false) == -1);
+
+	/* Buffered messages are still received after close */
+	uthread_yield();
+	for (i = 0; i < 5; i++) {
+		TEST_ASSERT(uthread_chan_recv(buffered, &value) == 0);
+		TEST_ASSERT(value == i);
+	}
+	TEST_ASSERT(uthread_chan_recv(buffered, &value) == -1);
+	TEST_ASSERT(value == 0);
+
+	/* Producer is blocked sending on unbuffered channel */
+	TEST_ASSERT(uthread_select(cases, 2, true) == 0);
+	TEST_ASSERT(cases[0].ok && value == 42);
+
+	/* Wake blocked producer with a close, then wait for it to finish */
+	uthread_yield();
+	uthread_chan_close(unbuffered);
+	TEST_ASSERT(uthread_select(cases, 2, true) == 0);
+	TEST_ASSERT(!cases[0].ok);
+	cases[0].chan = NULL;
+	TEST_ASSERT(uthread_select(cases, 2, true) == 1);
+	TEST_ASSERT(cases[1].ok && other == 42);
+}
+
+int main(void)
+{
+	buffered = uthread_chan_create(sizeof(int), 4);
+	unbuffered = uthread_chan_create(sizeof(int), 0);
+	done = uthread_chan_create(sizeof(int), 0);
+
+	uthread_run(false, consumer, NULL);
+
+	TEST_ASSERT(uthread_chan_destroy(buffered) == 0);
+	TEST_ASSERT(uthread_chan_destroy(unbuffered) == 0);
+	TEST_ASSERT(uthread_chan_destroy(done) == 0);
+
+	return 0;
+}
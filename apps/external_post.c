@@ -0,0 +1,93 @@
+/*
+ * Cross-OS-thread wakeup test
+ *
+ * A few pthreads release a semaphore and create threads in the library from
+ * outside of it, while a thread of the library waits on that semaphore. The
+ * library must sleep while its only thread is blocked, and be woken up by the
+ * pthreads. Exits with a failure if a release or a thread creation is lost.
+ * Without any pthread attached, a thread blocked for good must not keep the
+ * library from returning.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define NPTHREADS	4
+#define NPOSTS		1000
+
+sem_t sem;
+int created;
+
+static void posted(void *arg)
+{
+	(void)arg;
+
+	created++;
+}
+
+static void *poster(void *arg)
+{
+	int i;
+	(void)arg;
+
+	for (i = 0; i < NPOSTS; i++) {
+		while (uthread_post_external(posted, NULL))
+			;
+		while (sem_up_external(sem))
+			;
+	}
+	uthread_external_detach();
+
+	return NULL;
+}
+
+static void waiter(void *arg)
+{
+	pthread_t pthreads[NPTHREADS];
+	int i;
+	(void)arg;
+
+	for (i = 0; i < NPTHREADS; i++) {
+		uthread_external_attach();
+		pthread_create(&pthreads[i], NULL, poster, NULL);
+	}
+
+	/* Each release is posted right after a thread creation */
+	for (i = 0; i < NPTHREADS * NPOSTS; i++)
+		sem_down(sem);
+	uthread_yield();
+
+	for (i = 0; i < NPTHREADS; i++)
+		pthread_join(pthreads[i], NULL);
+
+	printf("created = %d\n", created);
+	if (created != NPTHREADS * NPOSTS)
+		exit(1);
+}
+
+static void parked(void *arg)
+{
+	sem_down((sem_t)arg);
+}
+
+int main(void)
+{
+	sem_t never = sem_create(0);
+
+	sem = sem_create(0);
+
+	uthread_run(false, waiter, NULL);
+
+	sem_destroy(sem);
+
+	/* Nothing can release the semaphore, the library returns anyway */
+	if (uthread_run(false, parked, never))
+		exit(1);
+	printf("parked thread left blocked\n");
+
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Address-keyed wait/wake test
+ *
+ * Builds a mutex and a condition variable out of a single integer each, with
+ * uthread_wait_on() and uthread_wake(), and uses them to have many threads
+ * increment a shared counter. Threads yield inside the critical section to
+ * force contention. Exits with a failure if the final count is wrong.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <futex.h>
+#include <uthread.h>
+
+#define NTHREADS	100
+#define NLOOPS		10
+
+/* Mutex states */
+#define UNLOCKED	0
+#define LOCKED		1
+#define CONTENDED	2
+
+static int mutex = UNLOCKED;
+static int cond;
+static int counter, finished;
+
+static void mutex_lock(int *m)
+{
+	int c = __sync_val_compare_and_swap(m, UNLOCKED, LOCKED);
+
+	/* Mark the mutex contended and wait until it is released */
+	while (c != UNLOCKED) {
+		if (c == CONTENDED ||
+		    __sync_val_compare_and_swap(m, LOCKED, CONTENDED) != UNLOCKED)
+			uthread_wait_on(m, CONTENDED);
+		c = __sync_val_compare_and_swap(m, UNLOCKED, CONTENDED);
+	}
+}
+
+static void mutex_unlock(int *m)
+{
+	/* Only call into the library if somebody may be waiting */
+	if (__sync_fetch_and_sub(m, 1) != LOCKED) {
+		*m = UNLOCKED;
+		uthread_wake(m, 1);
+	}
+}
+
+static void cond_wait(int *c, int *m)
+{
+	int seq = *c;
+
+	mutex_unlock(m);
+	uthread_wait_on(c, seq);
+	mutex_lock(m);
+}
+
+static void cond_broadcast(int *c)
+{
+	__sync_fetch_and_add(c, 1);
+	uthread_wake(c, INT_MAX);
+}
+
+static void worker(void *arg)
+{
+	int i, value;
+	(void)arg;
+
+	for (i = 0; i < NLOOPS; i++) {
+		mutex_lock(&mutex);
+		value = counter;
+		uthread_yield();
+		counter = value + 1;
+		mutex_unlock(&mutex);
+		uthread_yield();
+	}
+
+	mutex_lock(&mutex);
+	finished++;
+	cond_broadcast(&cond);
+	mutex_unlock(&mutex);
+}
+
+static void master(void *arg)
+{
+	int i;
+	(void)arg;
+
+	for (i = 0; i < NTHREADS; i++)
+		uthread_create(worker, NULL);
+
+	mutex_lock(&mutex);
+	while (finished < NTHREADS)
+		cond_wait(&cond, &mutex);
+	mutex_unlock(&mutex);
+
+	printf("counter = %d\n", counter);
+	if (counter != NTHREADS * NLOOPS)
+		exit(1);
+}
+
+int main(void)
+{
+	uthread_run(false, master, NULL);
+	return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * Lock-free queue stress test
+ *
+ * Several producer threads push tagged values into a small lock-free queue
+ * while several consumer threads pop them, half of the threads using the
+ * batched operations. Every value must be received exactly once, and the
+ * values of each producer must be received in order by each consumer.
+ *
+ * Build and run with ThreadSanitizer with `make tsan`.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lfqueue.h"
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+#define PRODUCERS	4
+#define CONSUMERS	4
+#define ITEMS		50000	/* Per producer */
+#define BATCH		8
+
+/* Values are (producer << 32 | index) + 1, so that none of them is NULL */
+#define VALUE(p, i)	((((uintptr_t)(p) << 32) | (i)) + 1)
+
+static lfqueue_t queue;
+static unsigned char received[PRODUCERS][ITEMS];
+static _Atomic int producers_left = PRODUCERS;
+
+struct consumer {
+	int id;
+	long count;
+	int errors;
+};
+
+static void *producer(void *arg)
+{
+	int id = (int)(intptr_t)arg;
+	void *batch[BATCH];
+	int i = 0, n, k;
+
+	while (i < ITEMS) {
+		if (id % 2) {
+			/* Single pushes */
+			if (lfqueue_try_push(queue, (void *)VALUE(id, i)) == 0)
+				i++;
+			else
+				sched_yield();
+			continue;
+		}
+
+		/* Batched pushes */
+		for (n = 0; n < BATCH && i + n < ITEMS; n++)
+			batch[n] = (void *)VALUE(id, i + n);
+		k = lfqueue_try_push_bulk(queue, batch, n);
+		if (k == 0)
+			sched_yield();
+		i += k;
+	}
+	producers_left--;
+
+	return NULL;
+}
+
+static void consume(struct consumer *c, long *last, void *data)
+{
+	uintptr_t value = (uintptr_t)data - 1;
+	int p = value >> 32;
+	long i = value & 0xffffffff;
+
+	if (p >= PRODUCERS || i >= ITEMS || i <= last[p]) {
+		c->errors++;
+		return;
+	}
+	last[p] = i;
+	received[p][i]++;
+	c->count++;
+}
+
+static void *consumer(void *arg)
+{
+	struct consumer *c = arg;
+	long last[PRODUCERS];
+	void *batch[BATCH];
+	int p, n, k;
+
+	for (p = 0; p < PRODUCERS; p++)
+		last[p] = -1;
+
+	while (1) {
+		int done = producers_left == 0;
+
+		if (c->id % 2)
+			n = lfqueue_try_pop(queue, &batch[0]) == 0;
+		else
+			n = lfqueue_try_pop_bulk(queue, batch, BATCH);
+		for (k = 0; k < n; k++)
+			consume(c, last, batch[k]);
+
+		/* Queue was empty after all producers were done */
+		if (n == 0) {
+			if (done)
+				break;
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+int main(void)
+{
+	pthread_t producers[PRODUCERS], consumers[CONSUMERS];
+	struct consumer cons[CONSUMERS];
+	long total = 0;
+	int errors = 0, missing = 0;
+	int i, p;
+	void *data, *drain[100];
+
+	fprintf(stderr, "*** TEST lfqueue stress ***\n");
+
+	/* Small queue, so that it is often full */
+	queue = lfqueue_create(60);
+	TEST_ASSERT(queue != NULL);
+	TEST_ASSERT(lfqueue_create(0) == NULL);
+
+	for (i = 0; i < CONSUMERS; i++) {
+		cons[i] = (struct consumer){ .id = i };
+		pthread_create(&consumers[i], NULL, consumer, &cons[i]);
+	}
+	for (i = 0; i < PRODUCERS; i++)
+		pthread_create(&producers[i], NULL, producer,
+			       (void *)(intptr_t)i);
+
+	for (i = 0; i < PRODUCERS; i++)
+		pthread_join(producers[i], NULL);
+	for (i = 0; i < CONSUMERS; i++) {
+		pthread_join(consumers[i], NULL);
+		total += cons[i].count;
+		errors += cons[i].errors;
+	}
+
+	for (p = 0; p < PRODUCERS; p++)
+		for (i = 0; i < ITEMS; i++)
+			missing += received[p][i] != 1;
+
+	TEST_ASSERT(errors == 0);
+	TEST_ASSERT(missing == 0);
+	TEST_ASSERT(total == (long)PRODUCERS * ITEMS);
+	TEST_ASSERT(lfqueue_try_pop(queue, &data) == -1);
+
+	/* Capacity is rounded up to a power of two */
+	for (i = 0; lfqueue_try_push(queue, &total) == 0; i++)
+		;
+	TEST_ASSERT(i == 64);
+	TEST_ASSERT(lfqueue_try_pop_bulk(queue, drain, 100) == 64);
+	TEST_ASSERT(lfqueue_destroy(queue) == 0);
+
+	return 0;
+}
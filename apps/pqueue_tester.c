@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pqueue.h"
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+struct item {
+	int value;
+	struct pqueue_node node;
+};
+
+static int pop_value(pqueue_t pq)
+{
+	struct pqueue_node *node;
+
+	if (pqueue_pop(pq, &node))
+		return -1;
+	return pqueue_entry(node, struct item, node)->value;
+}
+
+/* Create and destroy */
+void test_create(void)
+{
+	struct item a = { .value = 1 };
+	pqueue_t pq;
+
+	fprintf(stderr, "*** TEST create ***\n");
+
+	pq = pqueue_create(0);
+	TEST_ASSERT(pq != NULL);
+	TEST_ASSERT(pqueue_length(pq) == 0);
+	pqueue_insert(pq, &a.node, 1);
+	TEST_ASSERT(pqueue_destroy(pq) == -1);
+	pop_value(pq);
+	TEST_ASSERT(pqueue_destroy(pq) == 0);
+	TEST_ASSERT(pqueue_destroy(NULL) == -1);
+}
+
+/* Items come out by key, and in insertion order for equal keys */
+void test_order(void)
+{
+	struct item items[6];
+	uint64_t keys[6] = { 30, 10, 20, 10, 5, 30 };
+	int expected[6] = { 4, 1, 3, 2, 0, 5 };
+	struct pqueue_node *node;
+	pqueue_t pq;
+	int i;
+
+	fprintf(stderr, "*** TEST order ***\n");
+
+	pq = pqueue_create(0);
+	for (i = 0; i < 6; i++) {
+		items[i].value = i;
+		pqueue_insert(pq, &items[i].node, keys[i]);
+	}
+	TEST_ASSERT(pqueue_length(pq) == 6);
+	TEST_ASSERT(pqueue_insert(pq, &items[2].node, 1) == -1);
+
+	pqueue_peek(pq, &node);
+	TEST_ASSERT(node == &items[4].node && node->key == 5);
+	for (i = 0; i < 6; i++)
+		if (pop_value(pq) != expected[i])
+			break;
+	TEST_ASSERT(i == 6);
+	TEST_ASSERT(pqueue_pop(pq, &node) == -1);
+	TEST_ASSERT(pqueue_peek(pq, &node) == -1);
+	pqueue_destroy(pq);
+}
+
+/* Decrease key and delete */
+void test_handles(void)
+{
+	struct item items[5];
+	pqueue_t pq;
+	int i;
+
+	fprintf(stderr, "*** TEST handles ***\n");
+
+	pq = pqueue_create(2);
+	for (i = 0; i < 5; i++) {
+		items[i].value = i;
+		pqueue_insert(pq, &items[i].node, 10 * (i + 1));
+	}
+
+	TEST_ASSERT(pqueue_decrease_key(pq, &items[3].node, 5) == 0);
+	TEST_ASSERT(pqueue_decrease_key(pq, &items[3].node, 50) == -1);
+	TEST_ASSERT(pqueue_delete(pq, &items[1].node) == 0);
+	TEST_ASSERT(pqueue_delete(pq, &items[1].node) == -1);
+	TEST_ASSERT(pqueue_contains(pq, &items[1].node) == 0);
+	TEST_ASSERT(pqueue_contains(pq, &items[2].node) == 1);
+	TEST_ASSERT(pqueue_length(pq) == 4);
+
+	TEST_ASSERT(pop_value(pq) == 3);
+	TEST_ASSERT(pop_value(pq) == 0);
+	TEST_ASSERT(pop_value(pq) == 2);
+	TEST_ASSERT(pop_value(pq) == 4);
+	TEST_ASSERT(pqueue_contains(pq, &items[4].node) == 0);
+	pqueue_destroy(pq);
+}
+
+/* Random operations, checked against the smallest key still queued */
+void test_random(void)
+{
+	struct item *items = calloc(1000, sizeof(struct item));
+	uint64_t prev = 0;
+	pqueue_t pq;
+	int i, sorted = 1;
+
+	fprintf(stderr, "*** TEST random ***\n");
+
+	srand(42);
+	pq = pqueue_create(0);
+	for (i = 0; i < 1000; i++) {
+		items[i].value = i;
+		pqueue_insert(pq, &items[i].node, rand() % 500);
+	}
+	for (i = 0; i < 1000; i += 3)
+		pqueue_delete(pq, &items[i].node);
+	for (i = 1; i < 1000; i += 3)
+		pqueue_decrease_key(pq, &items[i].node, items[i].node.key / 2);
+	TEST_ASSERT(pqueue_length(pq) == 666);
+
+	while (pqueue_length(pq) > 0) {
+		struct pqueue_node *node;
+
+		pqueue_pop(pq, &node);
+		if (node->key < prev)
+			sorted = 0;
+		prev = node->key;
+	}
+	TEST_ASSERT(sorted);
+	pqueue_destroy(pq);
+	free(items);
+}
+
+int main(void)
+{
+	test_create();
+	test_order();
+	test_handles();
+	test_random();
+
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Preemption clock test
+ *
+ * Run two threads that never yield under each clock, with a short quantum, and
+ * check that they are preempted. Under the monotonic clock, a thread sleeping
+ * in a system call is preempted as well. A thread running alone doesn't get
+ * any timer signal once its first slice is over.
+ */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+static volatile bool done;
+static int set_quantum;
+
+static void setter(void *arg)
+{
+	(void)arg;
+	set_quantum = uthread_set_quantum(2000);
+	done = true;
+}
+
+/* Busy loop until the other thread runs */
+static void spinner(void *arg)
+{
+	(void)arg;
+	done = false;
+	uthread_create(setter, NULL);
+	while (!done) {
+	}
+}
+
+/* Sleep until the other thread runs */
+static void sleeper(void *arg)
+{
+	(void)arg;
+	done = false;
+	uthread_create(setter, NULL);
+	while (!done)
+		usleep(1000);
+}
+
+static bool timer_armed(void)
+{
+	struct itimerval it;
+
+	getitimer(ITIMER_VIRTUAL, &it);
+	return it.it_value.tv_sec || it.it_value.tv_usec;
+}
+
+static struct sigaction lib_sa;
+static volatile sig_atomic_t alarms;
+
+/* Count timer signals, and pass them on to the library */
+static void count_alarm(int signum, siginfo_t *info, void *ucontext)
+{
+	alarms++;
+	lib_sa.sa_sigaction(signum, info, ucontext);
+}
+
+/* Busy loop for @ms milliseconds of CPU time, or until a timer signal */
+static void spin_cpu(long ms, bool until_alarm)
+{
+	clock_t start = clock();
+
+	while (clock() - start < ms * CLOCKS_PER_SEC / 1000) {
+		if (until_alarm && alarms) {
+			break;
+		}
+	}
+}
+
+static int alarms_alone;
+static bool armed_with_other;
+
+/* Spin alone without any timer signal, then with another thread */
+static void alone(void *arg)
+{
+	struct sigaction sa = { .sa_sigaction = count_alarm };
+
+	(void)arg;
+	sigaction(SIGVTALRM, NULL, &lib_sa);
+	sa.sa_flags = lib_sa.sa_flags;
+	sa.sa_mask = lib_sa.sa_mask;
+	sigaction(SIGVTALRM, &sa, NULL);
+
+	/* The timer armed while the idle thread was ready expires once, late
+	 * with a coarse process clock; then no signal must fire for 100
+	 * quanta */
+	alarms = 0;
+	spin_cpu(200, true);
+	alarms = 0;
+	spin_cpu(100, false);
+	alarms_alone = alarms;
+	sigaction(SIGVTALRM, &lib_sa, NULL);
+
+	done = false;
+	uthread_create(setter, NULL);
+	armed_with_other = timer_armed();
+	while (!done) {
+	}
+}
+
+static void nopreempt(void *arg)
+{
+	(void)arg;
+	set_quantum = uthread_set_quantum(2000);
+}
+
+int main(void)
+{
+	struct uthread_run_opts opts = { .preempt = true, .quantum_us = 1000 };
+	int clocks[] = {
+		UTHREAD_CLOCK_VIRTUAL,
+		UTHREAD_CLOCK_PROF,
+		UTHREAD_CLOCK_MONOTONIC,
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++) {
+		opts.clock = clocks[i];
+		set_quantum = -1;
+		TEST_ASSERT(uthread_run_ex(&opts, spinner, NULL) == 0);
+		TEST_ASSERT(done && set_quantum == 0);
+	}
+
+	opts.clock = UTHREAD_CLOCK_MONOTONIC;
+	set_quantum = -1;
+	TEST_ASSERT(uthread_run_ex(&opts, sleeper, NULL) == 0);
+	TEST_ASSERT(done && set_quantum == 0);
+
+	/* Tickless: no timer while a thread runs alone */
+	opts.clock = UTHREAD_CLOCK_VIRTUAL;
+	TEST_ASSERT(uthread_run_ex(&opts, alone, NULL) == 0);
+	TEST_ASSERT(alarms_alone == 0 && armed_with_other && done);
+
+	/* Quantum can't be changed without preemption */
+	TEST_ASSERT(uthread_run_ex(NULL, nopreempt, NULL) == 0);
+	TEST_ASSERT(set_quantum == -1);
+
+	opts.clock = 42;
+	TEST_ASSERT(uthread_run_ex(&opts, nopreempt, NULL) == -1);
+
+	return 0;
+}
@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -63,6 +65,29 @@ void test_queue(void)
         TEST_ASSERT(retval == -1);
 }
 
+/* Peek */
+void test_peek(void)
+{
+	int data[] = {3, 4}, *ptr, retval;
+        queue_t q;
+
+        fprintf(stderr, "*** TEST peek ***\n");
+
+        q = queue_create();
+        retval = queue_peek(q, (void**) &ptr);
+        TEST_ASSERT(retval == -1);
+
+        queue_enqueue(q, &data[0]);
+        queue_enqueue(q, &data[1]);
+        queue_peek(q, (void**) &ptr);
+        TEST_ASSERT(ptr == &data[0]);
+        TEST_ASSERT(queue_length(q) == 2);
+
+        queue_dequeue(q, (void**) &ptr);
+        queue_peek(q, (void**) &ptr);
+        TEST_ASSERT(ptr == &data[1]);
+}
+
 /* Delete */
 void test_delete(void)
 {
@@ -146,6 +171,369 @@ void test_iterate(void)
         TEST_ASSERT(data[9] == 10);	
 }
 
+/* Ring buffer backend */
+void test_ring(void)
+{
+        int data[100], *ptr, i, retval;
+        queue_t q;
+
+        fprintf(stderr, "*** TEST ring ***\n");
+
+        /* Wrap around the initial buffer, then grow it */
+        q = queue_create_ex(4);
+        for (i = 0; i < 6; i++) {
+                queue_enqueue(q, &data[i]);
+        }
+        for (i = 0; i < 4; i++) {
+                queue_dequeue(q, (void**) &ptr);
+        }
+        for (i = 6; i < 100; i++) {
+                queue_enqueue(q, &data[i]);
+        }
+        TEST_ASSERT(queue_length(q) == 96);
+        queue_dequeue(q, (void**) &ptr);
+        TEST_ASSERT(ptr == &data[4]);
+
+        /* Delete middle, oldest and newest items */
+        TEST_ASSERT(queue_delete(q, &data[50]) == 0);
+        TEST_ASSERT(queue_delete(q, &data[5]) == 0);
+        TEST_ASSERT(queue_delete(q, &data[99]) == 0);
+        TEST_ASSERT(queue_delete(q, &data[99]) == -1);
+        TEST_ASSERT(queue_length(q) == 92);
+        for (i = 6; i < 99; i++) {
+                if (i == 50) {
+                        continue;
+                }
+                queue_dequeue(q, (void**) &ptr);
+                if (ptr != &data[i]) {
+                        break;
+                }
+        }
+        TEST_ASSERT(i == 99);
+        retval = queue_dequeue(q, (void**) &ptr);
+        TEST_ASSERT(retval == -1);
+        TEST_ASSERT(queue_destroy(q) == 0);
+}
+
+static void iterator_dequeue(queue_t q, void *data)
+{
+        int *a = (int*)data, *ptr;
+
+        /* Dequeue current item, and enqueue a new one */
+        if (*a == 2) {
+                queue_dequeue(q, (void**) &ptr);
+                queue_enqueue(q, ptr + 7);
+        }
+        iterator_inc(q, data);
+}
+
+/* Iterate over ring buffer backend */
+void test_ring_iterate(void)
+{
+	queue_t q;
+        int data[] = {1, 2, 3, 42, 4, 42, 5, 6, 7, 8}, *ptr;
+        size_t i;
+
+        fprintf(stderr, "*** TEST ring iterate ***\n");
+
+        q = queue_create_ex(1);
+        for (i = 0; i < 7; i++) {
+                queue_enqueue(q, &data[i]);
+        }
+
+        /* Delete items '42' and dequeue during iteration */
+        queue_iterate(q, (queue_func_t)iterator_inc);
+        TEST_ASSERT(queue_length(q) == 5);
+        queue_iterate(q, (queue_func_t)iterator_dequeue);
+        TEST_ASSERT(queue_length(q) == 5);
+        queue_dequeue(q, (void**) &ptr);
+        TEST_ASSERT(ptr == &data[1] && *ptr == 4);
+        queue_dequeue(q, (void**) &ptr);
+        TEST_ASSERT(ptr == &data[2] && *ptr == 5);
+        queue_dequeue(q, (void**) &ptr);
+        TEST_ASSERT(ptr == &data[4] && *ptr == 6);
+        queue_dequeue(q, (void**) &ptr);
+        TEST_ASSERT(ptr == &data[6] && *ptr == 7);
+        queue_dequeue(q, (void**) &ptr);
+        TEST_ASSERT(ptr == &data[7]);
+}
+
+/* Indexed queue */
+void test_indexed(void)
+{
+        int data[1000], *ptr, i;
+        queue_t q, plain;
+
+        fprintf(stderr, "*** TEST indexed ***\n");
+
+        q = queue_create_indexed();
+        plain = queue_create();
+        for (i = 0; i < 1000; i++) {
+                queue_enqueue(q, &data[i]);
+                queue_enqueue(plain, &data[i]);
+        }
+        TEST_ASSERT(queue_enqueue(q, &data[10]) == -1);
+        TEST_ASSERT(queue_length(q) == 1000);
+        TEST_ASSERT(queue_footprint(q) > queue_footprint(plain));
+
+        /* Delete every odd item, in reverse order */
+        for (i = 999; i > 0; i -= 2) {
+                if (queue_delete(q, &data[i]) == -1) {
+                        break;
+                }
+        }
+        TEST_ASSERT(i == -1);
+        TEST_ASSERT(queue_delete(q, &data[1]) == -1);
+        TEST_ASSERT(queue_contains(q, &data[1]) == 0);
+        TEST_ASSERT(queue_contains(q, &data[2]) == 1);
+        TEST_ASSERT(queue_length(q) == 500);
+
+        /* Remaining items are still dequeued in order */
+        for (i = 0; i < 1000; i += 2) {
+                queue_dequeue(q, (void**) &ptr);
+                if (ptr != &data[i] || queue_contains(q, ptr)) {
+                        break;
+                }
+        }
+        TEST_ASSERT(i == 1000);
+        TEST_ASSERT(queue_destroy(q) == 0);
+}
+
+/* Bulk enqueue and dequeue, on both backends */
+void test_bulk(void)
+{
+	int data[40], i, n;
+        void *items[40], *out[40];
+        queue_t queues[2];
+        queue_t q;
+        int b;
+
+        fprintf(stderr, "*** TEST bulk ***\n");
+
+        for (i = 0; i < 40; i++) {
+                items[i] = &data[i];
+        }
+        queues[0] = queue_create();
+        queues[1] = queue_create_ex(4);
+
+        for (b = 0; b < 2; b++) {
+                q = queues[b];
+                TEST_ASSERT(queue_enqueue_bulk(q, items, 30) == 30);
+                TEST_ASSERT(queue_length(q) == 30);
+
+                n = queue_dequeue_bulk(q, out, 10);
+                for (i = 0; i < n && out[i] == items[i]; i++) {
+                }
+                TEST_ASSERT(n == 10 && i == 10);
+
+                /* A NULL item stops enqueueing */
+                items[35] = NULL;
+                TEST_ASSERT(queue_enqueue_bulk(q, &items[30], 10) == 5);
+                items[35] = &data[35];
+                TEST_ASSERT(queue_length(q) == 25);
+
+                /* Fewer items than asked for */
+                n = queue_dequeue_bulk(q, out, 40);
+                for (i = 0; i < n && out[i] == items[i + 10]; i++) {
+                }
+                TEST_ASSERT(n == 25 && i == 25);
+                TEST_ASSERT(queue_dequeue_bulk(q, out, 40) == 0);
+                TEST_ASSERT(queue_destroy(q) == 0);
+        }
+        TEST_ASSERT(queue_enqueue_bulk(NULL, items, 1) == -1);
+        TEST_ASSERT(queue_dequeue_bulk(NULL, out, 1) == -1);
+}
+
+/* Splice */
+void test_splice(void)
+{
+	int data[10], i, *ptr;
+        queue_t dst, src;
+
+        fprintf(stderr, "*** TEST splice ***\n");
+
+        /* List into list */
+        dst = queue_create();
+        src = queue_create_indexed();
+        for (i = 0; i < 10; i++) {
+                queue_enqueue(i < 4 ? dst : src, &data[i]);
+        }
+        TEST_ASSERT(queue_splice(dst, src) == 0);
+        TEST_ASSERT(queue_length(dst) == 10);
+        TEST_ASSERT(queue_length(src) == 0);
+        TEST_ASSERT(queue_contains(src, &data[5]) == 0);
+        TEST_ASSERT(queue_splice(dst, dst) == -1);
+
+        /* Ring buffer into indexed list, with a duplicate left behind */
+        queue_destroy(src);
+        src = queue_create_ex(2);
+        queue_enqueue(src, &data[3]);
+        queue_enqueue(src, &data[0]);
+        TEST_ASSERT(queue_splice(src, dst) == 0);
+        TEST_ASSERT(queue_length(src) == 12);
+        queue_destroy(dst);
+        dst = queue_create_indexed();
+        TEST_ASSERT(queue_splice(dst, src) == -1);
+        TEST_ASSERT(queue_length(dst) == 2);
+        TEST_ASSERT(queue_length(src) == 10);
+
+        for (i = 0; i < 10; i++) {
+                queue_dequeue(src, (void**) &ptr);
+                if (ptr != &data[i]) {
+                        break;
+                }
+        }
+        TEST_ASSERT(i == 10);
+        queue_dequeue(dst, (void**) &ptr);
+        queue_dequeue(dst, (void**) &ptr);
+        TEST_ASSERT(ptr == &data[0]);
+        TEST_ASSERT(queue_destroy(src) == 0);
+        TEST_ASSERT(queue_destroy(dst) == 0);
+}
+
+static int find_odd(queue_t q, void *data)
+{
+        (void)q;
+        return (*(int*)data % 2) ? 7 : 0;
+}
+
+static int delete_until_big(queue_t q, void *data)
+{
+        if (*(int*)data > 3) {
+                return 1;
+        }
+        queue_delete(q, data);
+        return 0;
+}
+
+/* Iterate until */
+void test_iterate_until(void)
+{
+	int data[] = {2, 4, 5, 6, 7}, *ptr = NULL;
+        size_t i;
+        queue_t queues[2];
+        int b;
+
+        fprintf(stderr, "*** TEST iterate_until ***\n");
+
+        queues[0] = queue_create();
+        queues[1] = queue_create_ex(0);
+        for (b = 0; b < 2; b++) {
+                queue_t q = queues[b];
+
+                for (i = 0; i < sizeof(data) / sizeof(data[0]); i++) {
+                        queue_enqueue(q, &data[i]);
+                }
+                TEST_ASSERT(queue_iterate_until(q, find_odd, (void**) &ptr) == 7);
+                TEST_ASSERT(ptr == &data[2]);
+
+                /* Items may be deleted by the callback */
+                TEST_ASSERT(queue_iterate_until(q, delete_until_big, NULL) == 1);
+                TEST_ASSERT(queue_length(q) == 4);
+                queue_peek(q, (void**) &ptr);
+                TEST_ASSERT(ptr == &data[1]);
+
+                while (queue_dequeue(q, (void**) &ptr) == 0) {
+                }
+                TEST_ASSERT(queue_iterate_until(q, find_odd, NULL) == 0);
+                TEST_ASSERT(queue_destroy(q) == 0);
+        }
+        TEST_ASSERT(queue_iterate_until(NULL, find_odd, NULL) == -1);
+}
+
+/* Node pool */
+void test_pool(void)
+{
+	int data[100], i, j, *ptr;
+        struct queue_pool_stats before, after;
+        queue_t q;
+
+        fprintf(stderr, "*** TEST pool ***\n");
+
+        /* Indexed queues are linked lists with either backend */
+        q = queue_create_indexed();
+        for (i = 0; i < 100; i++) {
+                queue_enqueue(q, &data[i]);
+        }
+        while (queue_dequeue(q, (void**) &ptr) == 0) {
+        }
+
+        /* Steady state: every node is recycled */
+        queue_pool_get_stats(&before);
+        for (j = 0; j < 100; j++) {
+                for (i = 0; i < 100; i++) {
+                        queue_enqueue(q, &data[i]);
+                }
+                for (i = 0; i < 100; i++) {
+                        queue_dequeue(q, (void**) &ptr);
+                }
+        }
+        queue_pool_get_stats(&after);
+        TEST_ASSERT(after.misses == before.misses);
+        TEST_ASSERT(after.hits - before.hits == 100 * 100);
+        TEST_ASSERT(after.slabs == before.slabs);
+
+        /* Free slabs are released beyond the cap */
+        queue_pool_set_cap(0);
+        queue_enqueue(q, &data[0]);
+        queue_dequeue(q, (void**) &ptr);
+        queue_pool_get_stats(&after);
+        TEST_ASSERT(after.slabs == 0 && after.free_nodes == 0);
+        queue_pool_set_cap(1024);
+        queue_destroy(q);
+}
+
+/* Fill and drain a queue of its own from another OS thread */
+static void *pool_thread(void *arg)
+{
+        int data[100], i, j, *ptr;
+        struct queue_pool_stats stats;
+        queue_t q = queue_create_indexed();
+        intptr_t ok = 1;
+
+        (void)arg;
+        /* Starts with a pool of its own */
+        queue_pool_get_stats(&stats);
+        ok &= stats.slabs == 0 && stats.hits == 0;
+
+        for (j = 0; j < 2000; j++) {
+                for (i = 0; i < 100; i++) {
+                        queue_enqueue(q, &data[i]);
+                }
+                queue_delete(q, &data[j % 100]);
+                for (i = 0; i < 100; i++) {
+                        if (i == j % 100) {
+                                continue;
+                        }
+                        queue_dequeue(q, (void**) &ptr);
+                        ok &= ptr == &data[i];
+                }
+        }
+        ok &= queue_length(q) == 0;
+        queue_destroy(q);
+
+        return (void *)ok;
+}
+
+/* Node pools of concurrent OS threads */
+void test_pool_threads(void)
+{
+        pthread_t threads[4];
+        void *ok;
+        int i, all_ok = 1;
+
+        fprintf(stderr, "*** TEST pool_threads ***\n");
+
+        for (i = 0; i < 4; i++) {
+                pthread_create(&threads[i], NULL, pool_thread, NULL);
+        }
+        for (i = 0; i < 4; i++) {
+                pthread_join(threads[i], &ok);
+                all_ok &= ok != NULL;
+        }
+        TEST_ASSERT(all_ok);
+}
+
 /* Length */
 void test_length(void)
 {
@@ -174,11 +562,21 @@ void test_length(void)
 
 int main(void)
 {
+        /* First, while no other queue holds nodes */
+        test_pool();
+        test_pool_threads();
         test_queue();
+        test_peek();
         test_delete();
         test_destroy();
         test_length();
         test_iterate();
+        test_ring();
+        test_ring_iterate();
+        test_indexed();
+        test_bulk();
+        test_splice();
+        test_iterate_until();
 	
         return 0;
 }
@@ -0,0 +1,74 @@
+/*
+ * Reader-writer lock simple test
+ *
+ * A writer holds the lock while two readers and a second writer queue up
+ * behind it. Writers are preferred, so the second writer must get the lock
+ * before the readers, which must then be granted the lock together. The
+ * program should output:
+ *
+ * writer1
+ * writer2
+ * reader1 (readers: 2)
+ * reader2 (readers: 2)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <rwlock.h>
+#include <uthread.h>
+
+uthread_rwlock_t rwlock;
+int readers;
+
+static void reader(void *arg)
+{
+	int id = (int)(long)arg;
+
+	uthread_rwlock_rdlock(rwlock);
+	readers++;
+	/* Let the other reader in while we hold the lock */
+	uthread_yield();
+	printf("reader%d (readers: %d)\n", id, readers);
+	uthread_yield();
+	readers--;
+	uthread_rwlock_unlock(rwlock);
+}
+
+static void writer2(void *arg)
+{
+	(void)arg;
+
+	uthread_rwlock_wrlock(rwlock);
+	printf("writer2\n");
+	uthread_rwlock_unlock(rwlock);
+}
+
+static void writer1(void *arg)
+{
+	(void)arg;
+
+	uthread_rwlock_wrlock(rwlock);
+	uthread_create(reader, (void *)1L);
+	uthread_create(reader, (void *)2L);
+	uthread_create(writer2, NULL);
+
+	/* Let everybody queue up behind us */
+	uthread_yield();
+	printf("writer1\n");
+	uthread_rwlock_unlock(rwlock);
+}
+
+int main(void)
+{
+	rwlock = uthread_rwlock_create();
+
+	uthread_run(false, writer1, NULL);
+
+	if (uthread_rwlock_destroy(rwlock)) {
+		fprintf(stderr, "rwlock still in use\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Scheduler latency test
+ *
+ * Check, if the library collects statistics (`make STATS=1`), that yielding
+ * threads fill the ready-to-run delay histogram, that preempted threads fill
+ * the quantum utilization histogram, and that the summary can be printed
+ * periodically.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <latency.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+#define THREADS 4
+#define YIELDS 50
+#define PREEMPTIONS 3
+#define QUANTUM_US 2000
+#define REPORTS 3
+
+static void yielder(void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i = 0; i < YIELDS; i++)
+		uthread_yield();
+}
+
+static void yielders(void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i = 0; i < THREADS; i++)
+		uthread_create(yielder, NULL);
+}
+
+static void spinner(void *arg)
+{
+	struct uthread_stats stats;
+
+	(void)arg;
+	do {
+		uthread_stats(uthread_self(), &stats);
+	} while (stats.preempted_switches < PREEMPTIONS);
+}
+
+static void spinners(void *arg)
+{
+	(void)arg;
+	uthread_create(spinner, NULL);
+	uthread_create(spinner, NULL);
+}
+
+/* Sleep long enough for the idle thread to print several reports */
+static void sleeper(void *arg)
+{
+	sem_t sem = sem_create(0);
+	int i;
+
+	(void)arg;
+	for (i = 0; i < REPORTS; i++)
+		sem_down_timeout(sem, 3000000);
+	sem_destroy(sem);
+}
+
+static size_t count_lines(const char *buf, const char *prefix)
+{
+	size_t n = 0;
+
+	while ((buf = strstr(buf, prefix)) != NULL) {
+		n++;
+		buf++;
+	}
+
+	return n;
+}
+
+int main(void)
+{
+	struct uthread_run_opts opts = {
+		.preempt = true,
+		.quantum_us = QUANTUM_US,
+		.clock = UTHREAD_CLOCK_MONOTONIC,
+	};
+	struct uthread_hist ready, quantum;
+	char *buf;
+	size_t len, reports;
+	FILE *f;
+
+	if (uthread_latency(&ready, &quantum) == -1) {
+		printf("Statistics not collected\n");
+		TEST_ASSERT(uthread_latency_report(stdout) == -1);
+		TEST_ASSERT(uthread_latency_report_every(1, stdout) == -1);
+		return 0;
+	}
+	TEST_ASSERT(ready.count == 0 && quantum.count == 0);
+	TEST_ASSERT(uthread_hist_percentile(&ready, 50) == 0);
+
+	/* Cooperative threads wait in the ready queue but have no quantum */
+	uthread_run(false, yielders, NULL);
+	uthread_latency(&ready, &quantum);
+	TEST_ASSERT(ready.count >= THREADS * YIELDS);
+	TEST_ASSERT(ready.min <= uthread_hist_percentile(&ready, 50));
+	TEST_ASSERT(uthread_hist_percentile(&ready, 50) <=
+		    uthread_hist_percentile(&ready, 99));
+	TEST_ASSERT(uthread_hist_percentile(&ready, 99) <= ready.max);
+	TEST_ASSERT(uthread_hist_percentile(&ready, 100) == ready.max);
+	TEST_ASSERT(ready.sum >= ready.max);
+	TEST_ASSERT(quantum.count == 0);
+	uthread_latency_report(stdout);
+
+	/* Preempted threads use their full quantum */
+	uthread_latency_reset();
+	uthread_run_ex(&opts, spinners, NULL);
+	uthread_latency(&ready, &quantum);
+	TEST_ASSERT(quantum.count >= 2 * PREEMPTIONS);
+	TEST_ASSERT(quantum.max >= 50);
+	TEST_ASSERT(ready.count >= 2 * PREEMPTIONS);
+	uthread_latency_report(stdout);
+
+	/* Periodic report, stopped at the end of the run */
+	f = open_memstream(&buf, &len);
+	TEST_ASSERT(uthread_latency_report_every(1, NULL) == -1);
+	TEST_ASSERT(uthread_latency_report_every(1, f) == 0);
+	uthread_run(false, sleeper, NULL);
+	fflush(f);
+	reports = count_lines(buf, "ready_delay_ns");
+	TEST_ASSERT(reports >= 2);
+	uthread_run(false, sleeper, NULL);
+	fclose(f);
+	TEST_ASSERT(count_lines(buf, "ready_delay_ns") == reports);
+	free(buf);
+
+	return 0;
+}
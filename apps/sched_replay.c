@@ -0,0 +1,189 @@
+/*
+ * Deterministic scheduling test
+ *
+ * Check that the tick clock preempts threads at the same points from one run
+ * to the next for a given seed, and that runs preempted by ticks or by timer
+ * signals, and woken up by timers, can be recorded and replayed exactly.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <replay.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+#define WORKERS 4
+#define STEPS 200
+#define SLEEPS 3
+#define LOG_SIZE (1 << 20)
+
+/* Order in which threads entered the critical section */
+static uthread_t order[WORKERS * STEPS + SLEEPS];
+static size_t order_len;
+static sem_t mutex;
+static bool spin;
+
+static void enter(void)
+{
+	sem_down(mutex);
+	order[order_len++] = uthread_self();
+	sem_up(mutex);
+}
+
+static void worker(void *arg)
+{
+	sem_t own = sem_create(1);
+	volatile int i, j;
+
+	(void)arg;
+	for (i = 0; i < STEPS; i++) {
+		enter();
+		/* More ticks, and time for timer signals to fire */
+		sem_down(own);
+		for (j = 0; spin && j < 20000; j++)
+			;
+		sem_up(own);
+	}
+	sem_destroy(own);
+}
+
+static void sleeper(void *arg)
+{
+	sem_t never = sem_create(0);
+	int i;
+
+	(void)arg;
+	for (i = 0; i < SLEEPS; i++) {
+		sem_down_timeout(never, 100000);
+		enter();
+	}
+	sem_destroy(never);
+}
+
+static void workload(void *arg)
+{
+	int i;
+
+	order_len = 0;
+	mutex = sem_create(1);
+	for (i = 0; i < WORKERS; i++)
+		uthread_create(worker, NULL);
+	if (arg)
+		uthread_create(sleeper, NULL);
+}
+
+/* Run workload, and copy the resulting order into @out */
+static void run(const struct uthread_run_opts *opts, bool sleeps,
+		uthread_t *out)
+{
+	uthread_run_ex(opts, workload, sleeps ? (void *)1 : NULL);
+	sem_destroy(mutex);
+	memcpy(out, order, sizeof(order));
+}
+
+static size_t count_switches(const uthread_t *o, size_t len)
+{
+	size_t i, n = 0;
+
+	for (i = 1; i < len; i++)
+		n += o[i] != o[i - 1];
+
+	return n;
+}
+
+/*
+ * Record a run with @opts, then replay it without preemption
+ *
+ * Return: Log of the run
+ */
+static FILE *record_replay(const struct uthread_run_opts *opts)
+{
+	static uthread_t recorded[WORKERS * STEPS + SLEEPS];
+	static uthread_t replayed[WORKERS * STEPS + SLEEPS];
+	unsigned long decisions;
+	long count;
+	FILE *log = tmpfile();
+
+	TEST_ASSERT(uthread_record_start(LOG_SIZE) == 0);
+	run(opts, true, recorded);
+	uthread_record_stop();
+	count = uthread_record_save(log);
+	TEST_ASSERT(count > 0);
+	printf("Recorded %ld decisions in %ld bytes, %zu switches in order\n",
+	       count, ftell(log), count_switches(recorded, order_len));
+
+	rewind(log);
+	TEST_ASSERT(uthread_replay_start(log) == 0);
+	run(NULL, true, replayed);
+	TEST_ASSERT(uthread_replay_stop(&decisions) == 0);
+	TEST_ASSERT(decisions == (unsigned long)count);
+	TEST_ASSERT(memcmp(recorded, replayed, sizeof(recorded)) == 0);
+
+	return log;
+}
+
+int main(void)
+{
+	static uthread_t a[WORKERS * STEPS + SLEEPS], b[WORKERS * STEPS + SLEEPS];
+	struct uthread_run_opts opts = {
+		.preempt = true,
+		.quantum_us = 20,
+		.clock = UTHREAD_CLOCK_TICKS,
+		.seed = 42,
+	};
+	unsigned long decisions;
+	FILE *log;
+
+	/* Same seed, same interleaving */
+	run(&opts, false, a);
+	run(&opts, false, b);
+	TEST_ASSERT(count_switches(a, WORKERS * STEPS) > WORKERS * 10);
+	TEST_ASSERT(memcmp(a, b, sizeof(a)) == 0);
+	opts.seed = 43;
+	run(&opts, false, b);
+	TEST_ASSERT(memcmp(a, b, sizeof(a)) != 0);
+
+	/* Deterministic run, with timers */
+	log = record_replay(&opts);
+	fclose(log);
+
+	/* Run preempted by timer signals */
+	opts.clock = UTHREAD_CLOCK_MONOTONIC;
+	opts.quantum_us = 100;
+	spin = true;
+	log = record_replay(&opts);
+
+	/* A different program diverges from the log */
+	rewind(log);
+	TEST_ASSERT(uthread_replay_start(log) == 0);
+	run(NULL, false, b);
+	TEST_ASSERT(uthread_replay_stop(&decisions) == -1);
+	printf("Diverged after %lu decisions\n", decisions);
+
+	/* Invalid logs and states */
+	TEST_ASSERT(uthread_record_save(NULL) == -1);
+	TEST_ASSERT(uthread_record_start(0) == -1);
+	TEST_ASSERT(uthread_replay_stop(NULL) == -1);
+	rewind(log);
+	fputs("garbage", log);
+	rewind(log);
+	TEST_ASSERT(uthread_replay_start(log) == -1);
+	fclose(log);
+
+	return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Batched semaphore operations test
+ *
+ * Checks that sem_down_n() never takes resources partially and serves waiters
+ * in FIFO order, and that sem_up_n() wakes all the waiters it can satisfy in
+ * one call. Exits with a failure as soon as a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define NWAITERS 100
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+sem_t sem;
+int big_done, small_done, woken;
+
+static void big(void *arg)
+{
+	(void)arg;
+
+	sem_down_n(sem, 5);
+	big_done = 1;
+}
+
+static void small(void *arg)
+{
+	(void)arg;
+
+	sem_down(sem);
+	small_done = 1;
+}
+
+static void waiter(void *arg)
+{
+	(void)arg;
+
+	sem_down(sem);
+	woken++;
+}
+
+static void test(void *arg)
+{
+	int i;
+	(void)arg;
+
+	uthread_create(big, NULL);
+	uthread_create(small, NULL);
+	uthread_yield();
+
+	/* Oldest waiter wants 5: the small one behind it must not overtake */
+	sem_up(sem);
+	uthread_yield();
+	TEST_ASSERT(!big_done && !small_done);
+
+	/* 5 resources at once for the big one, none left for the small one */
+	sem_up_n(sem, 4);
+	uthread_yield();
+	TEST_ASSERT(big_done && !small_done);
+
+	sem_up(sem);
+	uthread_yield();
+	TEST_ASSERT(small_done);
+
+	/* A single release wakes up all waiters */
+	for (i = 0; i < NWAITERS; i++)
+		uthread_create(waiter, NULL);
+	uthread_yield();
+	TEST_ASSERT(woken == 0);
+	sem_up_n(sem, NWAITERS + 1);
+	uthread_yield();
+	TEST_ASSERT(woken == NWAITERS);
+	TEST_ASSERT(sem_trydown(sem) == 0);
+	TEST_ASSERT(sem_trydown(sem) == -1);
+}
+
+int main(void)
+{
+	sem = sem_create(0);
+
+	uthread_run(false, test, NULL);
+
+	TEST_ASSERT(sem_destroy(sem) == 0);
+
+	return 0;
+}
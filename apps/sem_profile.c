@@ -0,0 +1,126 @@
+/*
+ * Semaphore contention profile test
+ *
+ * Block several threads on a semaphore, take another one without contention,
+ * let a down time out on a third one, and check their profiles and the order
+ * of the contention report. Semaphores are only profiled if the library was
+ * built with `make STATS=1`.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+#define WAITERS 4
+
+static sem_t hot, cold, timed;
+
+static void waiter(void *arg)
+{
+	(void)arg;
+	sem_down(hot);
+}
+
+static unsigned long hist_sum(struct sem_profile *p)
+{
+	unsigned long sum = 0;
+	int i;
+
+	for (i = 0; i < SEM_WAIT_BUCKETS; i++)
+		sum += p->wait_hist[i];
+	return sum;
+}
+
+static void test_profile(void *arg)
+{
+	struct sem_profile p;
+	char *report = NULL;
+	size_t len;
+	FILE *f;
+	int i;
+
+	(void)arg;
+	hot = sem_create(0);
+	cold = sem_create(10);
+	timed = sem_create(0);
+	TEST_ASSERT(sem_set_name(NULL, "none") == -1);
+	TEST_ASSERT(sem_set_name(hot, "hot") == 0);
+	TEST_ASSERT(sem_set_name(cold, "cold") == 0);
+
+	if (sem_profile(hot, &p) == -1) {
+		printf("Semaphores not profiled\n");
+		TEST_ASSERT(sem_profile_report(stdout, 1) == -1);
+		goto out;
+	}
+
+	/* Contended semaphore */
+	for (i = 0; i < WAITERS; i++)
+		uthread_create(waiter, NULL);
+	uthread_yield();
+	sem_profile(hot, &p);
+	TEST_ASSERT(strcmp(p.name, "hot") == 0);
+	TEST_ASSERT(p.depth == WAITERS);
+	TEST_ASSERT(p.contended == WAITERS);
+	TEST_ASSERT(p.acquisitions == 0);
+	sem_up_n(hot, WAITERS);
+	uthread_yield();
+	sem_profile(hot, &p);
+	TEST_ASSERT(p.depth == 0);
+	TEST_ASSERT(p.max_depth == WAITERS);
+	TEST_ASSERT(p.acquisitions == WAITERS);
+	TEST_ASSERT(hist_sum(&p) == WAITERS);
+	TEST_ASSERT(p.wait_ns > 0);
+
+	/* Uncontended semaphore */
+	for (i = 0; i < 5; i++)
+		sem_down(cold);
+	sem_trydown(cold);
+	sem_profile(cold, &p);
+	TEST_ASSERT(p.acquisitions == 6);
+	TEST_ASSERT(p.contended == 0);
+	TEST_ASSERT(p.max_depth == 0);
+
+	/* Timed out wait */
+	TEST_ASSERT(sem_down_timeout(timed, 1000000) == -1);
+	sem_profile(timed, &p);
+	TEST_ASSERT(p.name[0] == '\0');
+	TEST_ASSERT(p.contended == 1);
+	TEST_ASSERT(p.acquisitions == 0);
+	TEST_ASSERT(p.wait_ns >= 1000000);
+
+	/* Most contended first */
+	f = open_memstream(&report, &len);
+	TEST_ASSERT(sem_profile_report(f, 2) == 2);
+	fclose(f);
+	printf("%s", report);
+	TEST_ASSERT(strncmp(strchr(report, '\n') + 1, "hot ", 4) == 0);
+	TEST_ASSERT(strstr(report, "cold") == NULL);
+	free(report);
+
+out:
+	sem_destroy(hot);
+	sem_destroy(cold);
+	sem_destroy(timed);
+}
+
+int main(void)
+{
+	uthread_run(false, test_profile, NULL);
+
+	return 0;
+}
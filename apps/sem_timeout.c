@@ -0,0 +1,87 @@
+/*
+ * Semaphore timeout test
+ *
+ * Checks non-blocking and timed semaphore operations: a thread times out while
+ * nobody releases the semaphore, then gets it before its timeout expires. While
+ * all threads are waiting on timeouts, the library must sleep until the next
+ * one instead of returning. Exits with a failure as soon as a check fails.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define MSEC 1000000ULL
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+sem_t sem, done;
+
+static unsigned long long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / MSEC;
+}
+
+static void releaser(void *arg)
+{
+	(void)arg;
+
+	/* Nobody releases sem for 20ms: the waiter times out first */
+	sem_down_timeout(done, 20 * MSEC);
+	sem_up(sem);
+}
+
+static void waiter(void *arg)
+{
+	unsigned long long start;
+	int ret;
+	(void)arg;
+
+	ret = sem_trydown(sem);
+	TEST_ASSERT(ret == -1 && errno == EAGAIN);
+
+	uthread_create(releaser, NULL);
+
+	start = now_ms();
+	ret = sem_down_timeout(sem, 10 * MSEC);
+	TEST_ASSERT(ret == -1 && errno == ETIMEDOUT);
+	TEST_ASSERT(now_ms() - start >= 10);
+
+	/* Released by the other thread 10ms later, before our timeout */
+	ret = sem_down_timeout(sem, 1000 * MSEC);
+	TEST_ASSERT(ret == 0);
+	TEST_ASSERT(now_ms() - start < 1000);
+
+	TEST_ASSERT(sem_down_timeout(sem, 0) == -1);
+	sem_up(sem);
+	TEST_ASSERT(sem_down_timeout(sem, 0) == 0);
+}
+
+int main(void)
+{
+	sem = sem_create(0);
+	done = sem_create(0);
+
+	uthread_run(false, waiter, NULL);
+
+	TEST_ASSERT(sem_destroy(sem) == 0);
+	TEST_ASSERT(sem_destroy(done) == 0);
+
+	return 0;
+}
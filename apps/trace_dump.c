@@ -0,0 +1,163 @@
+/*
+ * Scheduler tracing test
+ *
+ * Record the events of a ping-pong between two threads and of a preempted
+ * thread, and check that they show up in the Chrome trace dump. Check that
+ * nothing is recorded while tracing is disabled, and that a full ring buffer
+ * keeps the newest events.
+ */
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sem.h>
+#include <trace.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+#define ROUNDS 3
+
+static sem_t ping, pong;
+static volatile bool done;
+
+/* Dump of the trace, and number of events it contains */
+static char *dump;
+static int dumped;
+
+static void dump_trace(void)
+{
+	size_t len;
+	FILE *f;
+
+	free(dump);
+	f = open_memstream(&dump, &len);
+	dumped = uthread_trace_dump(f);
+	fclose(f);
+}
+
+static bool dump_has(const char *event)
+{
+	char name[64];
+
+	snprintf(name, sizeof(name), "\"name\": \"%s\"", event);
+	return strstr(dump, name) != NULL;
+}
+
+static void ponger(void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i = 0; i < ROUNDS; i++) {
+		sem_down(ping);
+		sem_up(pong);
+	}
+}
+
+static void pinger(void *arg)
+{
+	int i;
+
+	(void)arg;
+	ping = sem_create(0);
+	pong = sem_create(0);
+	uthread_create(ponger, NULL);
+	for (i = 0; i < ROUNDS; i++) {
+		sem_up(ping);
+		sem_down(pong);
+	}
+}
+
+static void yielder(void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i = 0; i < 100; i++)
+		uthread_yield();
+}
+
+static void setter(void *arg)
+{
+	(void)arg;
+	done = true;
+}
+
+/* Busy loop until the other thread runs */
+static void spinner(void *arg)
+{
+	(void)arg;
+	uthread_create(setter, NULL);
+	while (!done) {
+	}
+}
+
+int main(void)
+{
+	struct uthread_run_opts opts = {
+		.preempt = true,
+		.quantum_us = 2000,
+		.clock = UTHREAD_CLOCK_VIRTUAL,
+	};
+	int n;
+
+	TEST_ASSERT(uthread_trace_dump(stdout) == -1);
+	TEST_ASSERT(uthread_trace_enable(0) == -1);
+
+	/* Ping-pong */
+	TEST_ASSERT(uthread_trace_enable(4096) == 0);
+	uthread_run(false, pinger, NULL);
+	uthread_trace_disable();
+	dump_trace();
+	TEST_ASSERT(dumped > 0);
+	TEST_ASSERT(dump[0] == '[');
+	TEST_ASSERT(dump_has("create"));
+	TEST_ASSERT(dump_has("run"));
+	TEST_ASSERT(dump_has("yield"));
+	TEST_ASSERT(dump_has("block"));
+	TEST_ASSERT(dump_has("unblock"));
+	TEST_ASSERT(dump_has("exit"));
+	TEST_ASSERT(dump_has("sem_down"));
+	TEST_ASSERT(dump_has("sem_up"));
+	TEST_ASSERT(strstr(dump, "\"ph\": \"X\"") != NULL);
+
+	/* Nothing recorded while disabled */
+	n = dumped;
+	uthread_run(false, yielder, NULL);
+	dump_trace();
+	TEST_ASSERT(dumped == n);
+
+	/* Preemption */
+	uthread_trace_reset();
+	TEST_ASSERT(uthread_trace_enable(4096) == 0);
+	uthread_run_ex(&opts, spinner, NULL);
+	dump_trace();
+	TEST_ASSERT(dump_has("preempt"));
+
+	/* Full ring buffer keeps the newest events */
+	uthread_trace_reset();
+	TEST_ASSERT(uthread_trace_enable(6) == 0);
+	uthread_run(false, yielder, NULL);
+	dump_trace();
+	TEST_ASSERT(dumped == 8);
+	TEST_ASSERT(!dump_has("create"));
+	TEST_ASSERT(dump_has("exit"));
+
+	uthread_trace_reset();
+	free(dump);
+
+	return 0;
+}
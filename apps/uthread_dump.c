@@ -0,0 +1,177 @@
+/*
+ * Thread dump test
+ *
+ * Check that dumps list every thread with its state and what it is blocked
+ * on, whether requested through the API or with a signal, and time the dump
+ * of many blocked threads.
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chan.h>
+#include <dump.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+#define SEM_WAITERS 3
+#define MANY 10000
+
+static sem_t sem;
+static uthread_chan_t chan;
+static char buf[65536];
+
+static void sem_waiter(void *arg)
+{
+	(void)arg;
+	sem_down(sem);
+}
+
+static void chan_waiter(void *arg)
+{
+	int msg;
+
+	(void)arg;
+	uthread_chan_recv(chan, &msg);
+}
+
+static void yielder(void *arg)
+{
+	(void)arg;
+	uthread_yield();
+}
+
+/* Read back what was dumped into @f */
+static const char *dumped(FILE *f)
+{
+	size_t len;
+
+	fflush(f);
+	rewind(f);
+	len = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[len] = '\0';
+	rewind(f);
+	ftruncate(fileno(f), 0);
+
+	return buf;
+}
+
+static size_t count(const char *s, const char *pattern)
+{
+	size_t n = 0;
+
+	while ((s = strstr(s, pattern)) != NULL) {
+		n++;
+		s++;
+	}
+
+	return n;
+}
+
+static void test_dump(void *arg)
+{
+	FILE *f = tmpfile();
+	int i, msg = 0;
+
+	(void)arg;
+	sem = sem_create(0);
+	chan = uthread_chan_create(sizeof(int), 0);
+	for (i = 0; i < SEM_WAITERS; i++)
+		uthread_create(sem_waiter, NULL);
+	uthread_create(chan_waiter, NULL);
+	uthread_yield();
+	uthread_create(yielder, NULL);
+	uthread_create(yielder, NULL);
+
+	/* Idle thread, us, blocked waiters and new threads */
+	TEST_ASSERT(uthread_dump(-1, 0) == -1);
+	TEST_ASSERT(uthread_dump(fileno(f), 0) == 8);
+	dumped(f);
+	printf("%s", buf);
+	TEST_ASSERT(strstr(buf, "total 8: 1 running, 3 ready, 4 blocked "
+			   "(3 on sem, 1 on chan)\n") != NULL);
+	TEST_ASSERT(strstr(buf, "uthread 0 ready") != NULL);
+	TEST_ASSERT(strstr(buf, "uthread 1 running") != NULL);
+	TEST_ASSERT(count(buf, " on sem 0x") == SEM_WAITERS);
+	TEST_ASSERT(count(buf, " stack ") == 7);
+
+	/* Dump on signal, detailing only two threads */
+	TEST_ASSERT(uthread_dump_on_signal(SIGUSR1, -1, 0) == -1);
+	TEST_ASSERT(uthread_dump_on_signal(SIGUSR1, fileno(f), 2) == 0);
+	raise(SIGUSR1);
+	dumped(f);
+	printf("%s", buf);
+	TEST_ASSERT(strstr(buf, "uthread 1 running") != NULL);
+	TEST_ASSERT(strstr(buf, "6 more threads\n") != NULL);
+	TEST_ASSERT(strstr(buf, "total 8: ") != NULL);
+
+	/* State changes are timed while dumps on signal are enabled */
+	uthread_dump(fileno(f), 0);
+	TEST_ASSERT(count(dumped(f), "us on sem 0x") == SEM_WAITERS);
+	TEST_ASSERT(uthread_dump_on_signal(0, -1, 0) == 0);
+
+	for (i = 0; i < SEM_WAITERS; i++)
+		sem_up(sem);
+	uthread_chan_send(chan, &msg);
+	fclose(f);
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e3 +
+		(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void test_many(void *arg)
+{
+	struct timespec start;
+	int devnull = open("/dev/null", O_WRONLY);
+	int i;
+
+	(void)arg;
+	sem = sem_create(0);
+	for (i = 0; i < MANY; i++)
+		uthread_create(sem_waiter, NULL);
+	uthread_yield();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	TEST_ASSERT(uthread_dump(devnull, 100) == MANY + 2);
+	printf("Dump of %d threads, 100 detailed: %.3f ms\n", MANY + 2,
+	       elapsed_ms(&start));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	TEST_ASSERT(uthread_dump(devnull, 0) == MANY + 2);
+	printf("Dump of %d threads, all detailed: %.3f ms\n", MANY + 2,
+	       elapsed_ms(&start));
+
+	sem_up_n(sem, MANY);
+	close(devnull);
+}
+
+int main(void)
+{
+	TEST_ASSERT(uthread_dump(STDOUT_FILENO, 0) == -1);
+	uthread_run(false, test_dump, NULL);
+	uthread_run(false, test_many, NULL);
+
+	return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Sampling profiler test
+ *
+ * Profile two threads burning CPU time in different functions, and a thread
+ * running alone, and check that samples are attributed to the right threads
+ * and functions. Compiled with frame pointers for backtraces, and linked with
+ * -rdynamic so that function names are found.
+ */
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <profile.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+/* Iterations of busy loops, enough for several time slices */
+#define BURN_LOOPS 100000000UL
+
+static char *dump;
+static int dumped;
+static volatile bool done;
+
+static void dump_profile(void)
+{
+	size_t len;
+	FILE *f;
+
+	free(dump);
+	f = open_memstream(&dump, &len);
+	dumped = uthread_profile_dump(f);
+	fclose(f);
+	printf("%s", dump);
+}
+
+/* Sum of sample counts of the stacks containing all of @frames */
+static unsigned long samples_of(const char *thread, const char *func)
+{
+	unsigned long sum = 0;
+	char *line = dump, *end;
+
+	while ((end = strchr(line, '\n')) != NULL) {
+		*end = '\0';
+		if (strncmp(line, thread, strlen(thread)) == 0 &&
+		    strstr(line, func))
+			sum += strtoul(strrchr(line, ' ') + 1, NULL, 10);
+		*end = '\n';
+		line = end + 1;
+	}
+
+	return sum;
+}
+
+__attribute__((noinline)) void burn_a(void *arg)
+{
+	volatile unsigned long i;
+
+	(void)arg;
+	for (i = 0; i < BURN_LOOPS; i++) {
+	}
+}
+
+__attribute__((noinline)) void burn_b(void *arg)
+{
+	volatile unsigned long i;
+
+	(void)arg;
+	for (i = 0; i < BURN_LOOPS; i++) {
+	}
+}
+
+void burners(void *arg)
+{
+	(void)arg;
+	uthread_create(burn_b, NULL);
+	burn_a(NULL);
+	done = true;
+}
+
+int main(void)
+{
+	struct uthread_run_opts opts = {
+		.preempt = true,
+		.quantum_us = 10000,
+		.clock = UTHREAD_CLOCK_PROF,
+	};
+
+	TEST_ASSERT(uthread_profile_dump(stdout) == -1);
+	TEST_ASSERT(uthread_profile_start(0, 100) == -1);
+	TEST_ASSERT(uthread_profile_start(1000, 0) == -1);
+
+	/* Threads sharing the CPU */
+	TEST_ASSERT(uthread_profile_start(1000, 10000) == 0);
+	uthread_run_ex(&opts, burners, NULL);
+	dump_profile();
+	TEST_ASSERT(dumped > 0);
+	TEST_ASSERT(samples_of("uthread-1;", "burn_a") > 0);
+	TEST_ASSERT(samples_of("uthread-1;", ";burners;burn_a ") > 0);
+	TEST_ASSERT(samples_of("uthread-2;", "burn_b") > 0);
+	TEST_ASSERT(samples_of("uthread-1;", "burn_b") == 0);
+	TEST_ASSERT(samples_of("uthread-2;", "burn_a") == 0);
+
+	/* Thread running alone, which doesn't need the timer otherwise */
+	uthread_profile_reset();
+	TEST_ASSERT(uthread_profile_start(1000, 10000) == 0);
+	uthread_run_ex(&opts, burn_a, NULL);
+	uthread_profile_stop();
+	dump_profile();
+	TEST_ASSERT(samples_of("uthread-1;", "burn_a") > 0);
+
+	/* Full buffer drops samples */
+	uthread_profile_reset();
+	TEST_ASSERT(uthread_profile_start(1000, 4) == 0);
+	uthread_run_ex(&opts, burn_a, NULL);
+	dump_profile();
+	TEST_ASSERT(dumped == 4);
+
+	uthread_profile_reset();
+	free(dump);
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Profiler timer on the monotonic clock
+ *
+ * Sample with a tiny period on the monotonic clock, so that the timer fires
+ * while uthread_run_ex() is still setting up or tearing down the library, and
+ * check that those samples are dropped instead of crashing the process.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <profile.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+/* Number of library runs, each one with a setup and a teardown */
+#define RUNS 200
+
+static int finished;
+
+static void yielder(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < 10; i++)
+		uthread_yield();
+	finished++;
+}
+
+int main(void)
+{
+	struct uthread_run_opts opts = {
+		.preempt = true,
+		.quantum_us = 10000,
+		.clock = UTHREAD_CLOCK_MONOTONIC,
+	};
+	char *dump = NULL;
+	size_t len;
+	FILE *f;
+
+	TEST_ASSERT(uthread_profile_start(10, 1000000) == 0);
+	for (int i = 0; i < RUNS; i++)
+		uthread_run_ex(&opts, yielder, NULL);
+	uthread_profile_stop();
+	TEST_ASSERT(finished == RUNS);
+
+	f = open_memstream(&dump, &len);
+	TEST_ASSERT(uthread_profile_dump(f) >= 0);
+	fclose(f);
+
+	uthread_profile_reset();
+	free(dump);
+
+	return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * Stack usage test
+ *
+ * Measure the stacks of shallow and deep threads, and check their high-water
+ * marks and recommended sizes. Threads created while stack watching is
+ * disabled aren't measured.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <stack.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+#define SHALLOW_THREADS 3
+#define DEEP_BYTES 12288
+
+static void shallow(void *arg)
+{
+	(void)arg;
+}
+
+/* Use about @depth bytes of stack */
+__attribute__((noinline)) static void recurse(size_t depth)
+{
+	volatile char frame[1024];
+
+	memset((char *)frame, 0, sizeof(frame));
+	if (depth > sizeof(frame))
+		recurse(depth - sizeof(frame));
+	frame[0]++;
+}
+
+static void deep(void *arg)
+{
+	(void)arg;
+	recurse(DEEP_BYTES);
+}
+
+static void unwatched(void *arg)
+{
+	(void)arg;
+}
+
+static void spawner(void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i = 0; i < SHALLOW_THREADS; i++)
+		uthread_create(shallow, NULL);
+	uthread_create(deep, NULL);
+
+	uthread_stack_watch(false);
+	uthread_create(unwatched, NULL);
+}
+
+static unsigned long hist_sum(struct uthread_stack_usage *u)
+{
+	unsigned long sum = 0;
+	int i;
+
+	for (i = 0; i < UTHREAD_STACK_BUCKETS; i++)
+		sum += u->hist[i];
+	return sum;
+}
+
+int main(void)
+{
+	struct uthread_stack_usage s, d;
+
+	TEST_ASSERT(uthread_stack_recommended() == 0);
+
+	uthread_stack_watch(true);
+	uthread_run(false, spawner, NULL);
+	uthread_stack_report(stdout);
+
+	TEST_ASSERT(uthread_stack_usage(shallow, &s) == 0);
+	TEST_ASSERT(s.threads == SHALLOW_THREADS);
+	TEST_ASSERT(hist_sum(&s) == SHALLOW_THREADS);
+	TEST_ASSERT(s.max_bytes > 0 && s.max_bytes < DEEP_BYTES);
+
+	TEST_ASSERT(uthread_stack_usage(deep, &d) == 0);
+	TEST_ASSERT(d.threads == 1);
+	TEST_ASSERT(d.max_bytes >= DEEP_BYTES);
+	TEST_ASSERT(d.max_bytes < UTHREAD_STACK_SIZE);
+	TEST_ASSERT(d.hist[d.max_bytes / UTHREAD_STACK_BUCKET] == 1);
+	TEST_ASSERT(d.recommended_bytes >= d.max_bytes + d.max_bytes / 2);
+	TEST_ASSERT((d.recommended_bytes & 4095) == 0);
+
+	TEST_ASSERT(uthread_stack_recommended() == d.recommended_bytes);
+	TEST_ASSERT(uthread_stack_usage(unwatched, &s) == -1);
+	/* The spawner itself was created before watching was disabled */
+	TEST_ASSERT(uthread_stack_usage(spawner, &s) == 0);
+
+	uthread_stack_reset();
+	TEST_ASSERT(uthread_stack_usage(deep, &d) == -1);
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Thread statistics test
+ *
+ * Check that threads are numbered in order of creation, and, if the library
+ * collects statistics (`make STATS=1`), that switches, times and semaphore
+ * waits are accounted to the right threads.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define TEST_ASSERT(assert)				\
+do {							\
+	printf("ASSERT: " #assert " ... ");		\
+	if (assert) {					\
+		printf("PASS\n");			\
+	} else	{					\
+		printf("FAIL\n");			\
+		exit(1);				\
+	}						\
+} while(0)
+
+#define YIELDS 10
+#define WAITS 3
+
+static sem_t sem;
+static struct uthread_stats yielder_stats, waiter_stats;
+static uthread_t yielder_tid, waiter_tid;
+static volatile bool done;
+
+static void yielder(void *arg)
+{
+	int i;
+
+	(void)arg;
+	yielder_tid = uthread_self();
+	for (i = 0; i < YIELDS; i++)
+		uthread_yield();
+	uthread_stats(yielder_tid, &yielder_stats);
+}
+
+static void waiter(void *arg)
+{
+	int i;
+
+	(void)arg;
+	waiter_tid = uthread_self();
+	for (i = 0; i < WAITS; i++)
+		sem_down(sem);
+	uthread_stats(waiter_tid, &waiter_stats);
+}
+
+static void test_stats(void *arg)
+{
+	struct uthread_stats stats;
+	int i;
+
+	(void)arg;
+	TEST_ASSERT(uthread_self() == 1);
+
+	if (uthread_runtime_stats(&stats) == -1) {
+		printf("Statistics not collected\n");
+		TEST_ASSERT(uthread_stats(uthread_self(), &stats) == -1);
+		return;
+	}
+
+	sem = sem_create(0);
+	uthread_create(yielder, NULL);
+	uthread_create(waiter, NULL);
+	uthread_yield();
+	TEST_ASSERT(yielder_tid == 2);
+	TEST_ASSERT(waiter_tid == 3);
+
+	for (i = 0; i < WAITS; i++) {
+		sem_up(sem);
+		uthread_yield();
+	}
+	while (uthread_stats(yielder_tid, &stats) == 0)
+		uthread_yield();
+
+	TEST_ASSERT(yielder_stats.voluntary_switches == YIELDS);
+	TEST_ASSERT(yielder_stats.preempted_switches == 0);
+	TEST_ASSERT(yielder_stats.sem_waits == 0);
+	TEST_ASSERT(yielder_stats.cpu_ns > 0);
+	TEST_ASSERT(yielder_stats.ready_ns > 0);
+	TEST_ASSERT(yielder_stats.blocked_ns == 0);
+
+	TEST_ASSERT(waiter_stats.voluntary_switches == WAITS);
+	TEST_ASSERT(waiter_stats.sem_waits == WAITS);
+	TEST_ASSERT(waiter_stats.blocked_ns > 0);
+
+	/* Exited threads can't be looked up, but still count in the total */
+	TEST_ASSERT(uthread_stats(waiter_tid, &stats) == -1);
+	TEST_ASSERT(uthread_stats(0, &stats) == 0);
+	TEST_ASSERT(uthread_runtime_stats(&stats) == 0);
+	TEST_ASSERT(stats.voluntary_switches >= YIELDS + WAITS);
+	TEST_ASSERT(stats.sem_waits == WAITS);
+	TEST_ASSERT(stats.cpu_ns >= yielder_stats.cpu_ns + waiter_stats.cpu_ns);
+
+	sem_destroy(sem);
+}
+
+static void setter(void *arg)
+{
+	(void)arg;
+	done = true;
+}
+
+/* Busy loop until the other thread runs */
+static void spinner(void *arg)
+{
+	struct uthread_stats stats;
+
+	(void)arg;
+	TEST_ASSERT(uthread_self() == 1);
+	uthread_create(setter, NULL);
+	while (!done) {
+	}
+
+	if (uthread_stats(uthread_self(), &stats) == 0) {
+		TEST_ASSERT(stats.preempted_switches > 0);
+		TEST_ASSERT(stats.voluntary_switches == 0);
+	}
+}
+
+int main(void)
+{
+	struct uthread_run_opts opts = {
+		.preempt = true,
+		.quantum_us = 2000,
+		.clock = UTHREAD_CLOCK_VIRTUAL,
+	};
+
+	uthread_run(false, test_stats, NULL);
+	uthread_run_ex(&opts, spinner, NULL);
+
+	return 0;
+}
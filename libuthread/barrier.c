@@ -0,0 +1,225 @@
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "barrier.h"
+#include "queue.h"
+#include "private.h"
+
+struct uthread_barrier {
+	size_t count;	/* Threads per round */
+	size_t arrived;	/* Threads already arrived in current round */
+	queue_t wait_q;
+};
+
+struct uthread_latch {
+	size_t count;
+	queue_t wait_q;
+};
+
+struct uthread_waitgroup {
+	long count;
+	queue_t wait_q;
+};
+
+/*
+ * wait_q_destroy - Deallocate object embedding a wait queue
+ * @obj: Object to deallocate
+ * @wait_q: Wait queue of object
+ *
+ * Return: -1 if threads are still waiting in @wait_q, 0 otherwise
+ */
+static int wait_q_destroy(void *obj, queue_t wait_q)
+{
+	preempt_disable();
+	if (queue_destroy(wait_q)) {
+		preempt_enable();
+		return -1;
+	}
+	free(obj);
+	preempt_enable();
+
+	return 0;
+}
+
+/*
+ * wait_q_block - Block current thread in wait queue
+ * @wait_q: Wait queue of object
+ * @what: Kind of object
+ * @obj: Object embedding @wait_q
+ *
+ * Preemption must be disabled by the caller; it is enabled again on return.
+ */
+static void wait_q_block(queue_t wait_q, const char *what, const void *obj)
+{
+	queue_enqueue(wait_q, uthread_current());
+	uthread_set_wait(what, obj);
+	uthread_block();
+}
+
+uthread_barrier_t uthread_barrier_create(size_t count)
+{
+	if (count == 0)
+		return NULL;
+
+	preempt_disable();
+	uthread_barrier_t barrier = malloc(sizeof(struct uthread_barrier));
+
+	if (barrier == NULL) {
+		preempt_enable();
+		return NULL;
+	}
+	barrier->count = count;
+	barrier->arrived = 0;
+	barrier->wait_q = queue_create();
+	preempt_enable();
+
+	return barrier;
+}
+
+int uthread_barrier_destroy(uthread_barrier_t barrier)
+{
+	if (barrier == NULL)
+		return -1;
+
+	return wait_q_destroy(barrier, barrier->wait_q);
+}
+
+int uthread_barrier_wait(uthread_barrier_t barrier)
+{
+	if (barrier == NULL)
+		return -1;
+
+	preempt_disable();
+
+	/* Last thread of the round releases everybody and starts a new round */
+	if (++barrier->arrived == barrier->count) {
+		barrier->arrived = 0;
+		uthread_unblock_all(barrier->wait_q);
+		return UTHREAD_BARRIER_SERIAL_THREAD;
+	}
+	wait_q_block(barrier->wait_q, "barrier", barrier);
+
+	return 0;
+}
+
+uthread_latch_t uthread_latch_create(size_t count)
+{
+	preempt_disable();
+	uthread_latch_t latch = malloc(sizeof(struct uthread_latch));
+
+	if (latch == NULL) {
+		preempt_enable();
+		return NULL;
+	}
+	latch->count = count;
+	latch->wait_q = queue_create();
+	preempt_enable();
+
+	return latch;
+}
+
+int uthread_latch_destroy(uthread_latch_t latch)
+{
+	if (latch == NULL)
+		return -1;
+
+	return wait_q_destroy(latch, latch->wait_q);
+}
+
+int uthread_latch_count_down(uthread_latch_t latch)
+{
+	if (latch == NULL)
+		return -1;
+
+	preempt_disable();
+	if (latch->count == 0) {
+		preempt_enable();
+		return -1;
+	}
+	if (--latch->count == 0) {
+		uthread_unblock_all(latch->wait_q);
+		return 0;
+	}
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_latch_wait(uthread_latch_t latch)
+{
+	if (latch == NULL)
+		return -1;
+
+	preempt_disable();
+	if (latch->count > 0) {
+		wait_q_block(latch->wait_q, "latch", latch);
+		return 0;
+	}
+	preempt_enable();
+
+	return 0;
+}
+
+uthread_waitgroup_t uthread_waitgroup_create(void)
+{
+	preempt_disable();
+	uthread_waitgroup_t wg = malloc(sizeof(struct uthread_waitgroup));
+
+	if (wg == NULL) {
+		preempt_enable();
+		return NULL;
+	}
+	wg->count = 0;
+	wg->wait_q = queue_create();
+	preempt_enable();
+
+	return wg;
+}
+
+int uthread_waitgroup_destroy(uthread_waitgroup_t wg)
+{
+	if (wg == NULL)
+		return -1;
+
+	return wait_q_destroy(wg, wg->wait_q);
+}
+
+int uthread_waitgroup_add(uthread_waitgroup_t wg, long delta)
+{
+	if (wg == NULL)
+		return -1;
+
+	preempt_disable();
+	if (wg->count + delta < 0) {
+		preempt_enable();
+		return -1;
+	}
+	wg->count += delta;
+	if (wg->count == 0 && delta != 0) {
+		uthread_unblock_all(wg->wait_q);
+		return 0;
+	}
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_waitgroup_done(uthread_waitgroup_t wg)
+{
+	return uthread_waitgroup_add(wg, -1);
+}
+
+int uthread_waitgroup_wait(uthread_waitgroup_t wg)
+{
+	if (wg == NULL)
+		return -1;
+
+	preempt_disable();
+	if (wg->count > 0) {
+		wait_q_block(wg->wait_q, "waitgroup", wg);
+		return 0;
+	}
+	preempt_enable();
+
+	return 0;
+}
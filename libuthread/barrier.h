@@ -0,0 +1,150 @@
+#ifndef _BARRIER_H
+#define _BARRIER_H
+
+#include <stddef.h>
+
+/*
+ * uthread_barrier_t - Barrier type
+ *
+ * A barrier blocks threads until a given number of them have reached it, at
+ * which point all of them are released together. A barrier can be reused
+ * right away for the next round.
+ */
+typedef struct uthread_barrier *uthread_barrier_t;
+
+/*
+ * Value returned by uthread_barrier_wait() to one thread of each round
+ */
+#define UTHREAD_BARRIER_SERIAL_THREAD 1
+
+/*
+ * uthread_barrier_create - Create barrier
+ * @count: Number of threads to wait for in each round
+ *
+ * Return: Pointer to initialized barrier. NULL if @count is 0 or in case of
+ * failure when allocating the new barrier.
+ */
+uthread_barrier_t uthread_barrier_create(size_t count);
+
+/*
+ * uthread_barrier_destroy - Deallocate a barrier
+ * @barrier: Barrier to deallocate
+ *
+ * Return: -1 if @barrier is NULL or if threads are still waiting on it. 0 if
+ * @barrier was successfully destroyed.
+ */
+int uthread_barrier_destroy(uthread_barrier_t barrier);
+
+/*
+ * uthread_barrier_wait - Wait on a barrier
+ * @barrier: Barrier to wait on
+ *
+ * Block the caller thread until the number of threads given at creation have
+ * called this function. The last thread to arrive releases all the others and
+ * returns without blocking.
+ *
+ * Return: -1 if @barrier is NULL. UTHREAD_BARRIER_SERIAL_THREAD for the last
+ * thread of the round, 0 for the other threads.
+ */
+int uthread_barrier_wait(uthread_barrier_t barrier);
+
+/*
+ * uthread_latch_t - Latch type
+ *
+ * A latch is a single-use countdown: threads waiting on it are blocked until
+ * its count reaches zero, after which waiting never blocks again.
+ */
+typedef struct uthread_latch *uthread_latch_t;
+
+/*
+ * uthread_latch_create - Create latch
+ * @count: Initial count of the latch
+ *
+ * Return: Pointer to initialized latch. NULL in case of failure when
+ * allocating the new latch.
+ */
+uthread_latch_t uthread_latch_create(size_t count);
+
+/*
+ * uthread_latch_destroy - Deallocate a latch
+ * @latch: Latch to deallocate
+ *
+ * Return: -1 if @latch is NULL or if threads are still waiting on it. 0 if
+ * @latch was successfully destroyed.
+ */
+int uthread_latch_destroy(uthread_latch_t latch);
+
+/*
+ * uthread_latch_count_down - Decrement latch count
+ * @latch: Latch to count down
+ *
+ * When the count reaches zero, all the threads waiting on @latch are released.
+ *
+ * Return: -1 if @latch is NULL or if its count is already zero. 0 otherwise.
+ */
+int uthread_latch_count_down(uthread_latch_t latch);
+
+/*
+ * uthread_latch_wait - Wait for latch count to reach zero
+ * @latch: Latch to wait on
+ *
+ * Return: -1 if @latch is NULL. 0 once the count of @latch is zero.
+ */
+int uthread_latch_wait(uthread_latch_t latch);
+
+/*
+ * uthread_waitgroup_t - Wait group type
+ *
+ * A wait group counts outstanding tasks. Tasks are added to the group before
+ * being started and marked as done when they finish; threads waiting on the
+ * group are blocked until no task is outstanding. Unlike a latch, a wait group
+ * can be reused once its count has dropped to zero.
+ */
+typedef struct uthread_waitgroup *uthread_waitgroup_t;
+
+/*
+ * uthread_waitgroup_create - Create wait group
+ *
+ * Return: Pointer to initialized wait group, with no outstanding task. NULL in
+ * case of failure when allocating the new wait group.
+ */
+uthread_waitgroup_t uthread_waitgroup_create(void);
+
+/*
+ * uthread_waitgroup_destroy - Deallocate a wait group
+ * @wg: Wait group to deallocate
+ *
+ * Return: -1 if @wg is NULL or if threads are still waiting on it. 0 if @wg
+ * was successfully destroyed.
+ */
+int uthread_waitgroup_destroy(uthread_waitgroup_t wg);
+
+/*
+ * uthread_waitgroup_add - Add to wait group count
+ * @wg: Wait group
+ * @delta: Number of tasks to add, or to remove if negative
+ *
+ * When the count reaches zero, all the threads waiting on @wg are released.
+ *
+ * Return: -1 if @wg is NULL or if the count would become negative, in which
+ * case it is left unchanged. 0 otherwise.
+ */
+int uthread_waitgroup_add(uthread_waitgroup_t wg, long delta);
+
+/*
+ * uthread_waitgroup_done - Mark one task of wait group as done
+ * @wg: Wait group
+ *
+ * Same as uthread_waitgroup_add(@wg, -1).
+ */
+int uthread_waitgroup_done(uthread_waitgroup_t wg);
+
+/*
+ * uthread_waitgroup_wait - Wait for all tasks of wait group
+ * @wg: Wait group to wait on
+ *
+ * Return: -1 if @wg is NULL. 0 once the count of @wg is zero.
+ */
+int uthread_waitgroup_wait(uthread_waitgroup_t wg);
+
+#endif /* _BARRIER_H */
@@ -0,0 +1,367 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chan.h"
+#include "queue.h"
+#include "private.h"
+
+/* Number of select cases handled without allocating memory */
+#define CHAN_SELECT_STACK 4
+
+/*
+ * Blocked thread, possibly waiting on several channels at once. The first
+ * channel operation able to proceed completes it.
+ */
+struct chan_park {
+	struct uthread_tcb *tcb;
+	struct chan_waiter *waiters;
+	size_t n;
+	int index;	/* Case that completed */
+	bool ok;	/* Whether it completed successfully */
+};
+
+/* Pending operation of a blocked thread in a channel wait queue */
+struct chan_waiter {
+	struct chan_park *park;
+	uthread_chan_t chan;
+	void *elem;
+	int index;
+	int op;
+};
+
+struct uthread_chan {
+	size_t elem_size;
+	size_t capacity;
+	size_t count;	/* Number of buffered messages */
+	size_t head;	/* Slot of oldest buffered message */
+	bool closed;
+	char *buf;
+	queue_t send_q;	/* Blocked senders */
+	queue_t recv_q;	/* Blocked receivers */
+};
+
+static char *chan_slot(uthread_chan_t chan, size_t i)
+{
+	return chan->buf + (i % chan->capacity) * chan->elem_size;
+}
+
+static queue_t chan_wait_q(uthread_chan_t chan, int op)
+{
+	return op == UTHREAD_CHAN_SEND ? chan->send_q : chan->recv_q;
+}
+
+/*
+ * chan_fire - Complete the operation of a blocked thread
+ * @w: Waiter, already removed from its channel wait queue
+ * @ok: Outcome of the operation
+ *
+ * Withdraw the other operations the thread was waiting on, if any.
+ *
+ * Return: TCB of thread to wake up
+ */
+static struct uthread_tcb *chan_fire(struct chan_waiter *w, bool ok)
+{
+	struct chan_park *park = w->park;
+	size_t i;
+
+	for (i = 0; i < park->n; i++) {
+		struct chan_waiter *other = &park->waiters[i];
+
+		if (other != w && other->chan != NULL)
+			queue_delete(chan_wait_q(other->chan, other->op), other);
+	}
+	park->index = w->index;
+	park->ok = ok;
+
+	return park->tcb;
+}
+
+/*
+ * chan_try_send - Send message if possible without blocking
+ *
+ * Return: true if the operation completed, in which case @ok is set with its
+ * outcome and @wake with the receiver to switch to, if any
+ */
+static bool chan_try_send(uthread_chan_t chan, const void *elem, bool *ok,
+			  struct uthread_tcb **wake)
+{
+	struct chan_waiter *w;
+
+	if (chan->closed) {
+		*ok = false;
+		return true;
+	}
+
+	/* A blocked receiver means an empty buffer: hand message over */
+	if (queue_dequeue(chan->recv_q, (void **) &w) == 0) {
+		memcpy(w->elem, elem, chan->elem_size);
+		*wake = chan_fire(w, true);
+		*ok = true;
+		return true;
+	}
+
+	if (chan->count < chan->capacity) {
+		memcpy(chan_slot(chan, chan->head + chan->count), elem,
+		       chan->elem_size);
+		chan->count++;
+		*ok = true;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * chan_try_recv - Receive message if possible without blocking
+ *
+ * Return: true if the operation completed, in which case @ok is set with its
+ * outcome and @wake with the sender to wake up, if any
+ */
+static bool chan_try_recv(uthread_chan_t chan, void *elem, bool *ok,
+			  struct uthread_tcb **wake)
+{
+	struct chan_waiter *w;
+
+	if (chan->count > 0) {
+		memcpy(elem, chan_slot(chan, chan->head), chan->elem_size);
+		chan->head = (chan->head + 1) % chan->capacity;
+		chan->count--;
+
+		/* Refill freed slot from the oldest blocked sender */
+		if (queue_dequeue(chan->send_q, (void **) &w) == 0) {
+			memcpy(chan_slot(chan, chan->head + chan->count),
+			       w->elem, chan->elem_size);
+			chan->count++;
+			*wake = chan_fire(w, true);
+		}
+		*ok = true;
+		return true;
+	}
+
+	/* Unbuffered channel: take message straight from a blocked sender */
+	if (queue_dequeue(chan->send_q, (void **) &w) == 0) {
+		memcpy(elem, w->elem, chan->elem_size);
+		*wake = chan_fire(w, true);
+		*ok = true;
+		return true;
+	}
+
+	if (chan->closed) {
+		memset(elem, 0, chan->elem_size);
+		*ok = false;
+		return true;
+	}
+
+	return false;
+}
+
+uthread_chan_t uthread_chan_create(size_t elem_size, size_t capacity)
+{
+	if (elem_size == 0)
+		return NULL;
+
+	preempt_disable();
+	uthread_chan_t chan = malloc(sizeof(struct uthread_chan));
+
+	if (chan == NULL) {
+		preempt_enable();
+		return NULL;
+	}
+	chan->buf = NULL;
+	if (capacity > 0) {
+		chan->buf = malloc(elem_size * capacity);
+		if (chan->buf == NULL) {
+			free(chan);
+			preempt_enable();
+			return NULL;
+		}
+	}
+	chan->elem_size = elem_size;
+	chan->capacity = capacity;
+	chan->count = 0;
+	chan->head = 0;
+	chan->closed = false;
+	chan->send_q = queue_create();
+	chan->recv_q = queue_create();
+	preempt_enable();
+
+	return chan;
+}
+
+int uthread_chan_destroy(uthread_chan_t chan)
+{
+	if (chan == NULL || queue_length(chan->send_q) ||
+	    queue_length(chan->recv_q))
+		return -1;
+
+	preempt_disable();
+	queue_destroy(chan->send_q);
+	queue_destroy(chan->recv_q);
+	free(chan->buf);
+	free(chan);
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_select(struct uthread_select_case *cases, size_t n, bool block)
+{
+	struct chan_waiter stack_waiters[CHAN_SELECT_STACK], *waiters;
+	struct chan_park park;
+	size_t i, nchans = 0;
+
+	if (cases == NULL)
+		return -1;
+	for (i = 0; i < n; i++) {
+		if (cases[i].chan == NULL)
+			continue;
+		if (cases[i].elem == NULL || (cases[i].op != UTHREAD_CHAN_SEND
+					      && cases[i].op != UTHREAD_CHAN_RECV))
+			return -1;
+		nchans++;
+	}
+
+	preempt_disable();
+
+	/* 1. PERFORM FIRST OPERATION ABLE TO PROCEED */
+	for (i = 0; i < n; i++) {
+		struct uthread_select_case *c = &cases[i];
+		struct uthread_tcb *wake = NULL;
+
+		if (c->chan == NULL)
+			continue;
+
+		if (c->op == UTHREAD_CHAN_SEND) {
+			if (!chan_try_send(c->chan, c->elem, &c->ok, &wake))
+				continue;
+			/* Let the receiver consume its message right away */
+			if (wake)
+				uthread_switch_to(wake);
+			else
+				preempt_enable();
+		} else {
+			if (!chan_try_recv(c->chan, c->elem, &c->ok, &wake))
+				continue;
+			if (wake)
+				uthread_unblock(wake);
+			else
+				preempt_enable();
+		}
+		return i;
+	}
+
+	if (!block || nchans == 0) {
+		preempt_enable();
+		return -1;
+	}
+
+	/* 2. OTHERWISE WAIT ON ALL CHANNELS AT ONCE */
+	waiters = stack_waiters;
+	if (n > CHAN_SELECT_STACK) {
+		waiters = malloc(n * sizeof(*waiters));
+		if (waiters == NULL) {
+			preempt_enable();
+			return -1;
+		}
+	}
+
+	park.tcb = uthread_current();
+	park.waiters = waiters;
+	park.n = n;
+	for (i = 0; i < n; i++) {
+		waiters[i].park = &park;
+		waiters[i].chan = cases[i].chan;
+		waiters[i].elem = cases[i].elem;
+		waiters[i].index = i;
+		waiters[i].op = cases[i].op;
+		if (cases[i].chan != NULL)
+			queue_enqueue(chan_wait_q(cases[i].chan, cases[i].op),
+				      &waiters[i]);
+	}
+
+	/* The thread completing one of our operations withdraws the others */
+	if (nchans == 1) {
+		for (i = 0; cases[i].chan == NULL; i++)
+			;
+		uthread_set_wait("chan", cases[i].chan);
+	} else {
+		uthread_set_wait("select", cases);
+	}
+	uthread_block();
+
+	if (waiters != stack_waiters) {
+		preempt_disable();
+		free(waiters);
+		preempt_enable();
+	}
+	cases[park.index].ok = park.ok;
+
+	return park.index;
+}
+
+int uthread_chan_send(uthread_chan_t chan, const void *elem)
+{
+	struct uthread_select_case c = {
+		.chan = chan,
+		.op = UTHREAD_CHAN_SEND,
+		.elem = (void *)elem,
+	};
+
+	if (chan == NULL || elem == NULL)
+		return -1;
+
+	uthread_select(&c, 1, true);
+
+	return c.ok ? 0 : -1;
+}
+
+int uthread_chan_recv(uthread_chan_t chan, void *elem)
+{
+	struct uthread_select_case c = {
+		.chan = chan,
+		.op = UTHREAD_CHAN_RECV,
+		.elem = elem,
+	};
+
+	if (chan == NULL || elem == NULL)
+		return -1;
+
+	uthread_select(&c, 1, true);
+
+	return c.ok ? 0 : -1;
+}
+
+int uthread_chan_close(uthread_chan_t chan)
+{
+	struct chan_waiter *w;
+	queue_t woken;
+
+	if (chan == NULL)
+		return -1;
+
+	preempt_disable();
+	woken = queue_create();
+	if (chan->closed || woken == NULL) {
+		queue_destroy(woken);
+		preempt_enable();
+		return -1;
+	}
+	chan->closed = true;
+
+	/* Fail every pending operation and wake all the waiters at once */
+	while (queue_dequeue(chan->recv_q, (void **) &w) == 0) {
+		memset(w->elem, 0, chan->elem_size);
+		queue_enqueue(woken, chan_fire(w, false));
+	}
+	while (queue_dequeue(chan->send_q, (void **) &w) == 0)
+		queue_enqueue(woken, chan_fire(w, false));
+	uthread_unblock_all(woken);
+
+	preempt_disable();
+	queue_destroy(woken);
+	preempt_enable();
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+#ifndef _CHAN_H
+#define _CHAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * uthread_chan_t - Channel type
+ *
+ * A channel carries fixed-size messages from sending threads to receiving
+ * threads, in FIFO order. A buffered channel stores up to a given number of
+ * messages in a ring buffer, so that senders only block when it is full and
+ * receivers only block when it is empty. An unbuffered channel (of capacity 0)
+ * stores nothing: a sender blocks until a receiver takes its message, and vice
+ * versa.
+ *
+ * Messages are copied by value, from the sender's buffer into the receiver's
+ * buffer. When a receiver is already waiting, a sent message is copied
+ * directly into the receiver's buffer and the sender switches to the receiver
+ * right away.
+ */
+typedef struct uthread_chan *uthread_chan_t;
+
+/*
+ * uthread_chan_create - Create channel
+ * @elem_size: Size of a message in bytes
+ * @capacity: Number of messages the channel can buffer, 0 for an unbuffered
+ *	channel
+ *
+ * Return: Pointer to initialized channel. NULL if @elem_size is 0 or in case
+ * of failure when allocating the new channel.
+ */
+uthread_chan_t uthread_chan_create(size_t elem_size, size_t capacity);
+
+/*
+ * uthread_chan_destroy - Deallocate a channel
+ * @chan: Channel to deallocate
+ *
+ * Messages still buffered in @chan are discarded.
+ *
+ * Return: -1 if @chan is NULL or if threads are still waiting on @chan. 0 if
+ * @chan was successfully destroyed.
+ */
+int uthread_chan_destroy(uthread_chan_t chan);
+
+/*
+ * uthread_chan_send - Send message
+ * @chan: Channel to send to
+ * @elem: Address of message to send
+ *
+ * Copy the message at @elem into channel @chan. The caller thread is blocked
+ * while @chan is full, or until a receiver takes the message if @chan is
+ * unbuffered.
+ *
+ * Return: -1 if @chan or @elem are NULL, or if @chan is (or gets) closed
+ * before the message could be sent. 0 if the message was successfully sent.
+ */
+int uthread_chan_send(uthread_chan_t chan, const void *elem);
+
+/*
+ * uthread_chan_recv - Receive message
+ * @chan: Channel to receive from
+ * @elem: Address where to copy the received message
+ *
+ * Take the oldest message of channel @chan and copy it to @elem. The caller
+ * thread is blocked while no message is available. Messages buffered before
+ * @chan was closed can still be received.
+ *
+ * Return: -1 if @chan or @elem are NULL, or if @chan is closed and has no more
+ * messages, in which case @elem is zeroed. 0 if a message was received.
+ */
+int uthread_chan_recv(uthread_chan_t chan, void *elem);
+
+/*
+ * uthread_chan_close - Close channel
+ * @chan: Channel to close
+ *
+ * Mark channel @chan as closed: no message can be sent to it anymore. All the
+ * threads blocked sending to or receiving from @chan are woken up and their
+ * operation fails.
+ *
+ * Return: -1 if @chan is NULL or already closed. 0 if @chan was successfully
+ * closed.
+ */
+int uthread_chan_close(uthread_chan_t chan);
+
+/*
+ * Operations for uthread_select()
+ */
+#define UTHREAD_CHAN_SEND 0
+#define UTHREAD_CHAN_RECV 1
+
+/*
+ * struct uthread_select_case - Channel operation for uthread_select()
+ * @chan: Channel to operate on. Cases with a NULL channel are ignored
+ * @op: UTHREAD_CHAN_SEND or UTHREAD_CHAN_RECV
+ * @elem: Address of message to send, or address where to receive message
+ * @ok: Set by uthread_select() on the case that was selected: true if the
+ *	operation succeeded, false if it failed because @chan was closed
+ */
+struct uthread_select_case {
+	uthread_chan_t chan;
+	int op;
+	void *elem;
+	bool ok;
+};
+
+/*
+ * uthread_select - Wait on several channel operations
+ * @cases: Array of channel operations
+ * @n: Number of operations in @cases
+ * @block: Whether to wait for an operation to become possible
+ *
+ * Perform exactly one of the operations described in @cases. Operations are
+ * considered in array order and the first one that can proceed is performed.
+ * If none can proceed and @block is true, the caller thread is blocked until
+ * one of them can. An operation on a closed channel can always proceed and
+ * fails immediately.
+ *
+ * Return: Index in @cases of the operation that was performed. -1 if @cases
+ * is NULL, if an operation is invalid, or if @block is false and no operation
+ * could proceed.
+ */
+int uthread_select(struct uthread_select_case *cases, size_t n, bool block);
+
+#endif /* _CHAN_H */
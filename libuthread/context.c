@@ -1,10 +1,12 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "private.h"
+#include "stack.h"
 #include "uthread.h"
 
-/* Size of the stack for a thread (in bytes) */
-#define UTHREAD_STACK_SIZE 32768
+/* Pattern filling watched stacks, word by word */
+#define UTHREAD_STACK_CANARY 0xcafef00dcafef00dULL
 
 void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
 {
@@ -20,7 +22,28 @@ void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
 
 void *uthread_ctx_alloc_stack(void)
 {
-	return malloc(UTHREAD_STACK_SIZE);
+	uint64_t *stack = malloc(UTHREAD_STACK_SIZE);
+	size_t i;
+
+	if (stack && stack_watched) {
+		for (i = 0; i < UTHREAD_STACK_SIZE / sizeof(*stack); i++)
+			stack[i] = UTHREAD_STACK_CANARY;
+	}
+
+	return stack;
+}
+
+size_t uthread_ctx_stack_used(void *top_of_stack)
+{
+	uint64_t *stack = top_of_stack;
+	size_t i;
+
+	/* Stacks grow down: find the lowest word overwritten */
+	for (i = 0; i < UTHREAD_STACK_SIZE / sizeof(*stack); i++)
+		if (stack[i] != UTHREAD_STACK_CANARY)
+			break;
+
+	return UTHREAD_STACK_SIZE - i * sizeof(*stack);
 }
 
 void uthread_ctx_destroy_stack(void *top_of_stack)
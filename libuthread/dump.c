@@ -0,0 +1,310 @@
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "dump.h"
+#include "private.h"
+
+/* Maximum number of return addresses printed per thread */
+#define DUMP_DEPTH 16
+
+/* Maximum number of kinds of objects counted separately in totals */
+#define DUMP_KINDS 8
+
+bool dump_timed;
+
+/* Time from which state changes are timed */
+static uint64_t dump_timed_since;
+
+/* Dumps on signal */
+static int dump_signo;
+static int dump_sig_fd;
+static size_t dump_sig_max;
+static pid_t dump_tid;
+static struct sigaction dump_prev_sa;
+
+/*
+ * State of the dump in progress, only touched with preemption and the dump
+ * signal blocked
+ */
+static char dump_buf[4096];
+static size_t dump_len;
+static int dump_fd;
+static size_t dump_max, dump_threads;
+static uint64_t dump_now;
+static size_t dump_running, dump_ready, dump_blocked;
+static const char *dump_kinds[DUMP_KINDS];
+static size_t dump_kind_counts[DUMP_KINDS + 1];	/* Last one for the others */
+
+/* Context of the running thread */
+static uintptr_t dump_pc, dump_fp, dump_sp;
+
+static void dump_flush(void)
+{
+	size_t off = 0;
+	ssize_t n;
+
+	while (off < dump_len) {
+		n = write(dump_fd, dump_buf + off, dump_len - off);
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	dump_len = 0;
+}
+
+static void dump_str(const char *s)
+{
+	while (*s) {
+		if (dump_len == sizeof(dump_buf))
+			dump_flush();
+		dump_buf[dump_len++] = *s++;
+	}
+}
+
+static void dump_num(uint64_t value, unsigned int base)
+{
+	char digits[24];
+	int i = sizeof(digits) - 1;
+
+	digits[i] = '\0';
+	do {
+		digits[--i] = "0123456789abcdef"[value % base];
+		value /= base;
+	} while (value);
+	if (base == 16)
+		dump_str("0x");
+	dump_str(&digits[i]);
+}
+
+/* Walk frame pointers from @fp, within [@lo, @hi) */
+static void dump_backtrace(uintptr_t fp, uintptr_t lo, uintptr_t hi)
+{
+	uintptr_t *frame;
+	int depth = 0;
+
+	while (depth++ < DUMP_DEPTH && fp >= lo &&
+	       fp <= hi - 2 * sizeof(uintptr_t) &&
+	       fp % sizeof(uintptr_t) == 0) {
+		frame = (uintptr_t *)fp;
+		dump_str(" ");
+		dump_num(frame[1], 16);
+		/* Stacks grow down: callers' frames are above */
+		if (frame[0] <= fp)
+			break;
+		fp = frame[0];
+	}
+}
+
+static void dump_count_kind(const char *what)
+{
+	size_t i;
+
+	for (i = 0; i < DUMP_KINDS; i++) {
+		if (dump_kinds[i] == NULL)
+			dump_kinds[i] = what;
+		if (dump_kinds[i] == what)
+			break;
+	}
+	dump_kind_counts[i]++;
+	dump_blocked++;
+}
+
+/* Print time in state, a lower bound if unchanged since timing started */
+static void dump_time(uint64_t since)
+{
+	const char *sep = " ";
+
+#ifndef UTHREAD_STATS
+	if (!dump_timed)
+		return;
+	if (since < dump_timed_since) {
+		sep = " >";
+		since = dump_timed_since;
+	}
+#endif
+	dump_str(sep);
+	dump_num((dump_now - since) / 1000, 10);
+	dump_str("us");
+}
+
+static void dump_thread(const struct uthread_info *info)
+{
+	uintptr_t pc = dump_pc, fp = dump_fp, sp = dump_sp;
+
+	if (info->context == NULL)
+		dump_running++;
+	else if (strcmp(info->state, "blocked") == 0)
+		dump_count_kind(info->wait ? info->wait : "unknown");
+	else
+		dump_ready++;
+
+	/* Past the limit, only count threads without touching their context */
+	if (dump_max && dump_threads >= dump_max) {
+		dump_threads++;
+		return;
+	}
+	dump_threads++;
+
+	if (info->context) {
+#if defined(__x86_64__)
+		pc = info->context->uc_mcontext.gregs[REG_RIP];
+		fp = info->context->uc_mcontext.gregs[REG_RBP];
+		sp = info->context->uc_mcontext.gregs[REG_RSP];
+#else
+		pc = fp = sp = 0;
+#endif
+	}
+
+	dump_str("uthread ");
+	dump_num(info->tid, 10);
+	dump_str(" ");
+	dump_str(info->state);
+	dump_time(info->state_since);
+	if (info->wait) {
+		dump_str(" on ");
+		dump_str(info->wait);
+		dump_str(" ");
+		dump_num((uintptr_t)info->wait_obj, 16);
+	}
+	if (info->stack_hi && sp >= info->stack_lo && sp < info->stack_hi) {
+		dump_str(" stack ");
+		dump_num(info->stack_hi - sp, 10);
+	}
+	if (pc || fp) {
+		dump_str(" at");
+		if (pc) {
+			dump_str(" ");
+			dump_num(pc, 16);
+		}
+		/* The idle thread runs on the process stack, of unknown bounds */
+		if (info->stack_hi)
+			dump_backtrace(fp, info->stack_lo, info->stack_hi);
+	}
+	dump_str("\n");
+}
+
+/* Dump all threads, with preemption and the dump signal blocked */
+static int dump_all(int fd, size_t max_threads)
+{
+	size_t i;
+
+	dump_fd = fd;
+	dump_len = 0;
+	dump_max = max_threads;
+	dump_threads = dump_running = dump_ready = dump_blocked = 0;
+	memset(dump_kinds, 0, sizeof(dump_kinds));
+	memset(dump_kind_counts, 0, sizeof(dump_kind_counts));
+	dump_now = timer_now();
+
+	dump_str("uthread dump\n");
+	if (uthread_inspect(dump_thread)) {
+		dump_str("library not running\n");
+		dump_flush();
+		return -1;
+	}
+
+	if (dump_max && dump_threads > dump_max) {
+		dump_num(dump_threads - dump_max, 10);
+		dump_str(" more threads\n");
+	}
+	dump_str("total ");
+	dump_num(dump_threads, 10);
+	dump_str(": ");
+	dump_num(dump_running, 10);
+	dump_str(" running, ");
+	dump_num(dump_ready, 10);
+	dump_str(" ready, ");
+	dump_num(dump_blocked, 10);
+	dump_str(" blocked");
+	for (i = 0; i <= DUMP_KINDS && dump_kind_counts[i]; i++) {
+		dump_str(i ? ", " : " (");
+		dump_num(dump_kind_counts[i], 10);
+		dump_str(" on ");
+		dump_str(i < DUMP_KINDS ? dump_kinds[i] : "other");
+	}
+	dump_str(i ? ")\n" : "\n");
+	dump_flush();
+
+	return dump_threads;
+}
+
+int uthread_dump(int fd, size_t max_threads)
+{
+	int ret;
+
+	if (fd < 0)
+		return -1;
+
+	preempt_disable();
+	dump_fp = (uintptr_t)__builtin_frame_address(0);
+	dump_sp = dump_fp;
+	dump_pc = 0;
+	ret = dump_all(fd, max_threads);
+	preempt_enable();
+
+	return ret;
+}
+
+static void dump_handler(int signo, siginfo_t *info, void *ucontext)
+{
+	(void)info;
+
+	/* Only the OS thread running the library may walk its threads */
+	if (gettid() != dump_tid) {
+		tgkill(getpid(), dump_tid, signo);
+		return;
+	}
+
+#if defined(__x86_64__)
+	ucontext_t *uc = ucontext;
+
+	dump_pc = uc->uc_mcontext.gregs[REG_RIP];
+	dump_fp = uc->uc_mcontext.gregs[REG_RBP];
+	dump_sp = uc->uc_mcontext.gregs[REG_RSP];
+#else
+	(void)ucontext;
+	dump_pc = dump_fp = dump_sp = 0;
+#endif
+	dump_all(dump_sig_fd, dump_sig_max);
+}
+
+int uthread_dump_on_signal(int signo, int fd, size_t max_threads)
+{
+	struct sigaction sa;
+
+	if (signo < 0 || signo >= NSIG || (signo && fd < 0))
+		return -1;
+
+	if (dump_signo) {
+		preempt_defer_signal(0);
+		sigaction(dump_signo, &dump_prev_sa, NULL);
+		dump_signo = 0;
+		dump_timed = false;
+		dump_timed_since = 0;
+	}
+	if (signo == 0)
+		return 0;
+
+	/* Nothing may interrupt a dump, the timer signal included */
+	sa.sa_sigaction = dump_handler;
+	sigfillset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART | SA_SIGINFO;
+	if (sigaction(signo, &sa, &dump_prev_sa))
+		return -1;
+
+	dump_signo = signo;
+	dump_sig_fd = fd;
+	dump_sig_max = max_threads;
+	dump_tid = gettid();
+	dump_timed_since = timer_now();
+	dump_timed = true;
+	preempt_defer_signal(signo);
+
+	return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef _DUMP_H
+#define _DUMP_H
+
+#include <stddef.h>
+
+/*
+ * Thread dumps
+ *
+ * A dump describes every thread which hasn't exited yet, running and ready
+ * threads first, one line per thread: its identifier, its state, how long it
+ * has been in that state, the object it is blocked on if any, how many bytes
+ * of its stack are in use, and a backtrace from its saved context, e.g.
+ *
+ *	uthread 7 blocked 1520us on sem 0x5581c0a4b2a0 stack 432 at 0x55... 0x55...
+ *
+ * followed by totals per state and per kind of object. Return addresses are
+ * printed raw, to be resolved with addr2line against /proc/<pid>/maps; they
+ * are only found in code compiled with frame pointers.
+ *
+ * Dumps are written with write() from a fixed buffer, without allocating
+ * memory, so that they can be triggered by a signal while the library is
+ * wedged. The scheduler is stopped while dumping: with many threads, the
+ * number of threads detailed is best limited, the totals always cover them
+ * all.
+ */
+
+/*
+ * uthread_dump - Dump all threads
+ * @fd: File descriptor where to write the dump
+ * @max_threads: Maximum number of threads to detail, 0 for all
+ *
+ * Time in state is only known if the library was built with UTHREAD_STATS
+ * defined (`make STATS=1`) or while dumps on signal are enabled.
+ *
+ * Return: -1 if @fd is negative or if the library is not running. Number of
+ * threads otherwise.
+ */
+int uthread_dump(int fd, size_t max_threads);
+
+/*
+ * uthread_dump_on_signal - Dump all threads when a signal is received
+ * @signo: Signal triggering dumps, typically SIGUSR1, or 0 to stop
+ * @fd: File descriptor where to write dumps
+ * @max_threads: Maximum number of threads to detail, 0 for all
+ *
+ * Must be called from the OS thread running the library, before or while it
+ * runs. The signal is deferred while the library is in a critical section, and
+ * redirected to the OS thread running the library if another one receives it.
+ * While enabled, state changes are timed.
+ *
+ * Return: -1 if @signo is invalid, if @fd is negative, or in case of failure
+ * when installing the signal handler. 0 otherwise.
+ */
+int uthread_dump_on_signal(int signo, int fd, size_t max_threads);
+
+#endif /* _DUMP_H */
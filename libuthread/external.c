@@ -0,0 +1,287 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "private.h"
+#include "sem.h"
+#include "uthread.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+/*
+ * Request posted by another OS thread. Requests are linked into a lock-free
+ * multi-producer single-consumer queue (Vyukov's intrusive MPSC queue):
+ * producers only swap the head pointer, and the idle thread is the only
+ * consumer.
+ */
+struct ext_node {
+	_Atomic(struct ext_node *) next;
+	uthread_func_t func;	/* Function of thread to create, or NULL */
+	void *arg;		/* Argument of @func, or semaphore to release */
+};
+
+static struct ext_node stub;
+static _Atomic(struct ext_node *) inbox_head = &stub;
+static struct ext_node *inbox_tail = &stub;
+
+/* Event counter kicked by producers, -1 while the library is not running */
+static atomic_int inbox_fd = -1;
+
+/* Whether a kick is already pending, to save producers redundant syscalls */
+static atomic_bool inbox_kicked;
+
+/* Number of OS threads attached, which may still post requests */
+static atomic_long attached;
+
+/* Number of producers between reading and kicking the event counter, which
+ * can't be closed until they are done */
+static atomic_long producers;
+
+static void inbox_push(struct ext_node *node)
+{
+	struct ext_node *prev;
+
+	atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+	prev = atomic_exchange_explicit(&inbox_head, node, memory_order_acq_rel);
+	atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+/*
+ * inbox_pop - Get oldest request
+ *
+ * Return: Oldest request, or NULL if the inbox is empty. May spin briefly if a
+ * producer is in the middle of pushing a request.
+ */
+static struct ext_node *inbox_pop(void)
+{
+	struct ext_node *tail, *next, *head;
+
+	while (1) {
+		tail = inbox_tail;
+		next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+		/* Skip stub node */
+		if (tail == &stub) {
+			if (next == NULL)
+				return NULL;
+			inbox_tail = next;
+			tail = next;
+			next = atomic_load_explicit(&tail->next,
+						    memory_order_acquire);
+		}
+		if (next) {
+			inbox_tail = next;
+			return tail;
+		}
+
+		/* @tail is the last request: put stub back behind it */
+		head = atomic_load_explicit(&inbox_head, memory_order_acquire);
+		if (tail == head) {
+			inbox_push(&stub);
+			next = atomic_load_explicit(&tail->next,
+						    memory_order_acquire);
+			if (next) {
+				inbox_tail = next;
+				return tail;
+			}
+		}
+		/* A producer swapped the head but hasn't linked its node yet */
+	}
+}
+
+/*
+ * inbox_kick - Wake up the idle thread
+ * @fd: Event counter
+ *
+ * Return: 0 in case of success, -1 in case of failure
+ */
+static int inbox_kick(int fd)
+{
+	uint64_t one = 1;
+
+	/* Unless it has not consumed the last kick yet */
+	if (!atomic_exchange(&inbox_kicked, true)) {
+		if (write(fd, &one, sizeof(one)) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * producer_enter - Get event counter, and keep it open until producer_leave()
+ *
+ * Return: Event counter, -1 if the library is not running, in which case
+ * producer_leave() must not be called
+ */
+static int producer_enter(void)
+{
+	int fd;
+
+	/* Sequentially consistent, so that external_stop() either sees this
+	 * producer or makes it see the counter closed */
+	atomic_fetch_add(&producers, 1);
+	fd = atomic_load(&inbox_fd);
+	if (fd < 0)
+		atomic_fetch_sub(&producers, 1);
+
+	return fd;
+}
+
+static void producer_leave(void)
+{
+	atomic_fetch_sub(&producers, 1);
+}
+
+/*
+ * external_post - Post request from any OS thread
+ */
+static int external_post(uthread_func_t func, void *arg)
+{
+	struct ext_node *node;
+	int fd = producer_enter();
+	int ret;
+
+	if (fd < 0)
+		return -1;
+
+	node = malloc(sizeof(*node));
+	if (node == NULL) {
+		producer_leave();
+		return -1;
+	}
+	node->func = func;
+	node->arg = arg;
+	inbox_push(node);
+	ret = inbox_kick(fd);
+	producer_leave();
+
+	return ret;
+}
+
+int uthread_post_external(uthread_func_t func, void *arg)
+{
+	if (func == NULL)
+		return -1;
+
+	return external_post(func, arg);
+}
+
+void uthread_external_attach(void)
+{
+	atomic_fetch_add(&attached, 1);
+}
+
+void uthread_external_detach(void)
+{
+	int fd = producer_enter();
+
+	/* The idle thread may have nothing left to wait for: kick it after
+	 * detaching, so that it can't miss the change, but before the counter
+	 * can be closed */
+	atomic_fetch_sub(&attached, 1);
+	if (fd >= 0) {
+		inbox_kick(fd);
+		producer_leave();
+	}
+}
+
+int sem_up_external(sem_t sem)
+{
+	if (sem == NULL)
+		return -1;
+
+	return external_post(NULL, sem);
+}
+
+int external_start(void)
+{
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+	atomic_store(&inbox_kicked, false);
+	atomic_store(&inbox_fd, fd);
+
+	return 0;
+}
+
+void external_stop(void)
+{
+	struct ext_node *node;
+	int fd = atomic_exchange(&inbox_fd, -1);
+
+	/* Let producers which got the counter push their request and kick */
+	while (atomic_load(&producers) > 0)
+		sched_yield();
+
+	/* Discard requests that arrived too late */
+	preempt_disable();
+	while ((node = inbox_pop()) != NULL)
+		free(node);
+	preempt_enable();
+
+	if (fd >= 0)
+		close(fd);
+}
+
+void external_run(void)
+{
+	struct ext_node *node;
+
+	/* Consume the kick first, so that later requests kick again */
+	if (!atomic_exchange(&inbox_kicked, false))
+		return;
+
+	/* Process all pending requests in one batch */
+	while ((node = inbox_pop()) != NULL) {
+		if (node->func)
+			uthread_create(node->func, node->arg);
+		else
+			sem_up((sem_t) node->arg);
+
+		preempt_disable();
+		free(node);
+		preempt_enable();
+	}
+}
+
+bool external_pending(void)
+{
+	return atomic_load_explicit(&inbox_kicked, memory_order_relaxed);
+}
+
+bool external_expected(void)
+{
+	return atomic_load(&attached) > 0 || external_pending();
+}
+
+void external_wait(uint64_t deadline)
+{
+	struct pollfd pfd = { .fd = atomic_load(&inbox_fd), .events = POLLIN };
+	struct timespec ts, *timeout = NULL;
+	uint64_t now, count;
+
+	if (deadline) {
+		now = timer_now();
+		if (deadline <= now)
+			return;
+		ts.tv_sec = (deadline - now) / NSEC_PER_SEC;
+		ts.tv_nsec = (deadline - now) % NSEC_PER_SEC;
+		timeout = &ts;
+	}
+
+	/* Reset event counter, requests are processed by external_run() */
+	if (ppoll(&pfd, 1, timeout, NULL) > 0)
+		if (read(pfd.fd, &count, sizeof(count)) < 0)
+			return;
+}
@@ -0,0 +1,99 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "futex.h"
+#include "private.h"
+
+/* Number of wait lists, must be a power of 2 */
+#define FUTEX_BUCKETS 256
+
+/* Thread blocked on an address, allocated on its own stack */
+struct futex_waiter {
+	int *addr;
+	struct uthread_tcb *thread;
+	struct futex_waiter *prev, *next;
+};
+
+/* Wait list shared by all the addresses hashing to it */
+struct futex_bucket {
+	struct futex_waiter *head, *tail;
+};
+
+static struct futex_bucket buckets[FUTEX_BUCKETS];
+
+static struct futex_bucket *futex_bucket(int *addr)
+{
+	/* Fibonacci hashing, ignoring low bits that are always zero */
+	uint64_t h = ((uintptr_t)addr >> 2) * 0x9e3779b97f4a7c15ULL;
+
+	return &buckets[h >> 56 & (FUTEX_BUCKETS - 1)];
+}
+
+int uthread_wait_on(int *addr, int expected)
+{
+	struct futex_waiter waiter;
+	struct futex_bucket *bucket;
+
+	if (addr == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	preempt_disable();
+	if (*(volatile int *)addr != expected) {
+		preempt_enable();
+		errno = EAGAIN;
+		return -1;
+	}
+
+	/* Append to wait list, so that waiters are woken oldest first */
+	bucket = futex_bucket(addr);
+	waiter.addr = addr;
+	waiter.thread = uthread_current();
+	waiter.next = NULL;
+	waiter.prev = bucket->tail;
+	if (bucket->tail)
+		bucket->tail->next = &waiter;
+	else
+		bucket->head = &waiter;
+	bucket->tail = &waiter;
+
+	uthread_set_wait("futex", addr);
+	uthread_block();
+
+	return 0;
+}
+
+int uthread_wake(int *addr, int n)
+{
+	struct futex_waiter *waiter, *next;
+	struct futex_bucket *bucket;
+	int woken = 0;
+
+	if (addr == NULL)
+		return -1;
+
+	preempt_disable();
+	bucket = futex_bucket(addr);
+	for (waiter = bucket->head; waiter && woken < n; waiter = next) {
+		next = waiter->next;
+		if (waiter->addr != addr)
+			continue;
+
+		if (waiter->prev)
+			waiter->prev->next = waiter->next;
+		else
+			bucket->head = waiter->next;
+		if (waiter->next)
+			waiter->next->prev = waiter->prev;
+		else
+			bucket->tail = waiter->prev;
+
+		uthread_ready(waiter->thread);
+		woken++;
+	}
+	preempt_enable();
+
+	return woken;
+}
@@ -0,0 +1,41 @@
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+/*
+ * Address-keyed wait and wake
+ *
+ * Threads can block waiting on the address of any integer, and be woken up by
+ * other threads through that same address. The library keeps no state per
+ * address: waiters are linked into a global hash table of wait lists, keyed by
+ * address, only while they are blocked. A lock or a condition variable built on
+ * top of these two functions therefore only costs the integer it waits on.
+ */
+
+/*
+ * uthread_wait_on - Wait on address
+ * @addr: Address to wait on
+ * @expected: Value expected at @addr
+ *
+ * If the integer at @addr still contains @expected, block the caller thread
+ * until another thread calls uthread_wake() on @addr. The check and the
+ * blocking happen atomically with respect to other threads, so that a wake-up
+ * following a change of the value at @addr cannot be missed.
+ *
+ * Return: -1 if @addr is NULL (errno set to EINVAL) or if the integer at @addr
+ * did not contain @expected (errno set to EAGAIN). 0 once woken up.
+ */
+int uthread_wait_on(int *addr, int expected);
+
+/*
+ * uthread_wake - Wake threads waiting on address
+ * @addr: Address threads wait on
+ * @n: Maximum number of threads to wake up
+ *
+ * Wake up to @n threads waiting on @addr, oldest first. Pass INT_MAX to wake
+ * them all.
+ *
+ * Return: -1 if @addr is NULL. Number of threads woken up otherwise.
+ */
+int uthread_wake(int *addr, int n);
+
+#endif /* _FUTEX_H */
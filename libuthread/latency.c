@@ -0,0 +1,227 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "latency.h"
+#include "private.h"
+
+#define NSEC_PER_MSEC 1000000ULL
+
+#define HIST_SUB (1 << UTHREAD_HIST_SUB_BITS)
+
+#ifdef UTHREAD_STATS
+/* Percentiles printed by uthread_latency_report() */
+static const double latency_percentiles[] = { 50, 90, 99, 99.9 };
+
+static struct uthread_hist ready_delay_hist, quantum_use_hist;
+
+/* Periodic report */
+static struct uthread_timer latency_timer;
+static bool latency_armed;
+static uint64_t latency_period;
+static FILE *latency_out;
+#endif
+
+/* Highest value of bucket @i */
+static uint64_t hist_bucket_high(size_t i)
+{
+	int shift;
+
+	if (i < HIST_SUB)
+		return i;
+	shift = (i >> UTHREAD_HIST_SUB_BITS) - 1;
+
+	return ((uint64_t)(HIST_SUB + (i & (HIST_SUB - 1))) << shift) +
+		(((uint64_t)1 << shift) - 1);
+}
+
+uint64_t uthread_hist_percentile(const struct uthread_hist *hist, double p)
+{
+	unsigned long rank, seen = 0;
+	size_t i;
+
+	if (hist == NULL || hist->count == 0)
+		return 0;
+
+	/* Rank of the percentile among the recorded values, from 1 */
+	rank = p / 100 * hist->count;
+	if (rank < p / 100 * hist->count)
+		rank++;
+	if (rank == 0)
+		rank = 1;
+
+	for (i = 0; i < UTHREAD_HIST_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= rank)
+			break;
+	}
+	if (i == UTHREAD_HIST_BUCKETS || hist_bucket_high(i) > hist->max)
+		return hist->max;
+
+	return hist_bucket_high(i);
+}
+
+#ifdef UTHREAD_STATS
+/* Bucket of @value: its power of two, then its next UTHREAD_HIST_SUB_BITS bits */
+static size_t hist_index(uint64_t value)
+{
+	int e;
+
+	if (value < HIST_SUB)
+		return value;
+	e = 63 - __builtin_clzll(value);
+
+	return ((size_t)(e - UTHREAD_HIST_SUB_BITS + 1) << UTHREAD_HIST_SUB_BITS)
+		+ ((value >> (e - UTHREAD_HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+static void hist_record(struct uthread_hist *hist, uint64_t value)
+{
+	if (hist->count == 0 || value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+	hist->count++;
+	hist->sum += value;
+	hist->buckets[hist_index(value)]++;
+}
+
+void latency_ready_delay(uint64_t ns)
+{
+	hist_record(&ready_delay_hist, ns);
+}
+
+void latency_slice(uint64_t ns)
+{
+	unsigned long quantum_us = preempt_get_quantum();
+
+	if (quantum_us)
+		hist_record(&quantum_use_hist, ns / (quantum_us * 10));
+}
+
+static void latency_print_hist(FILE *out, const char *name,
+			       const struct uthread_hist *hist)
+{
+	size_t i;
+
+	fprintf(out, "%-16s %10lu %10llu", name, hist->count,
+		(unsigned long long)hist->min);
+	for (i = 0; i < sizeof(latency_percentiles) / sizeof(double); i++)
+		fprintf(out, " %10llu", (unsigned long long)
+			uthread_hist_percentile(hist, latency_percentiles[i]));
+	fprintf(out, " %10llu\n", (unsigned long long)hist->max);
+}
+
+/* Print summary, with preemption disabled */
+static void latency_print(FILE *out)
+{
+	size_t i;
+
+	fprintf(out, "%-16s %10s %10s", "histogram", "count", "min");
+	for (i = 0; i < sizeof(latency_percentiles) / sizeof(double); i++) {
+		char label[16];
+
+		snprintf(label, sizeof(label), "p%g", latency_percentiles[i]);
+		fprintf(out, " %10s", label);
+	}
+	fprintf(out, " %10s\n", "max");
+	latency_print_hist(out, "ready_delay_ns", &ready_delay_hist);
+	latency_print_hist(out, "quantum_use_pct", &quantum_use_hist);
+}
+
+/* Print periodic report and rearm timer, from the idle thread */
+static void latency_tick(void *arg)
+{
+	(void)arg;
+	latency_print(latency_out);
+	fflush(latency_out);
+	latency_armed = timer_start(&latency_timer, timer_now() + latency_period,
+				    latency_tick, NULL) == 0;
+}
+#endif
+
+int uthread_latency(struct uthread_hist *ready_delay,
+		    struct uthread_hist *quantum_use)
+{
+#ifdef UTHREAD_STATS
+	preempt_disable();
+	if (ready_delay)
+		*ready_delay = ready_delay_hist;
+	if (quantum_use)
+		*quantum_use = quantum_use_hist;
+	preempt_enable();
+
+	return 0;
+#else
+	(void)ready_delay;
+	(void)quantum_use;
+	return -1;
+#endif
+}
+
+int uthread_latency_report(FILE *out)
+{
+#ifdef UTHREAD_STATS
+	if (out == NULL)
+		return -1;
+
+	preempt_disable();
+	latency_print(out);
+	preempt_enable();
+
+	return 0;
+#else
+	(void)out;
+	return -1;
+#endif
+}
+
+int uthread_latency_report_every(unsigned long period_ms, FILE *out)
+{
+#ifdef UTHREAD_STATS
+	if (period_ms && out == NULL)
+		return -1;
+
+	preempt_disable();
+	latency_stop();
+	if (period_ms) {
+		latency_out = out;
+		latency_period = period_ms * NSEC_PER_MSEC;
+		if (timer_start(&latency_timer, timer_now() + latency_period,
+				latency_tick, NULL) == -1) {
+			preempt_enable();
+			return -1;
+		}
+		latency_armed = true;
+	}
+	preempt_enable();
+
+	return 0;
+#else
+	(void)period_ms;
+	(void)out;
+	return -1;
+#endif
+}
+
+void latency_stop(void)
+{
+#ifdef UTHREAD_STATS
+	if (latency_armed) {
+		timer_cancel(&latency_timer);
+		latency_armed = false;
+	}
+#endif
+}
+
+void uthread_latency_reset(void)
+{
+#ifdef UTHREAD_STATS
+	preempt_disable();
+	memset(&ready_delay_hist, 0, sizeof(ready_delay_hist));
+	memset(&quantum_use_hist, 0, sizeof(quantum_use_hist));
+	preempt_enable();
+#endif
+}
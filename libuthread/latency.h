@@ -0,0 +1,105 @@
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Scheduler latency histograms
+ *
+ * When the library is built with UTHREAD_STATS defined (`make STATS=1`), the
+ * scheduler keeps two global histograms:
+ * - the ready-to-run delay: time a thread spends in the ready queue, from the
+ *   moment it is created, unblocked or switched out while still runnable, to
+ *   the moment it runs again;
+ * - the quantum utilization: for each time slice, the time the thread ran
+ *   before switching out, in percent of the quantum. Only recorded while
+ *   preemption is enabled. Slices are timed with the monotonic clock, whatever
+ *   the clock driving preemption, and a thread alone runs past its quantum,
+ *   so values above 100 are possible.
+ *
+ * The idle thread is not accounted for. Histograms are kept across runs of the
+ * library, until uthread_latency_reset().
+ */
+
+/*
+ * HDR-style histogram layout
+ *
+ * Values below 2^UTHREAD_HIST_SUB_BITS have a bucket of their own. Each higher
+ * power-of-two range is split into 2^UTHREAD_HIST_SUB_BITS buckets of equal
+ * width, so that a value is known within 1/16th of itself (6.25%) over the
+ * whole 64-bit range.
+ */
+#define UTHREAD_HIST_SUB_BITS 4
+#define UTHREAD_HIST_BUCKETS ((64 - UTHREAD_HIST_SUB_BITS + 1) << \
+			      UTHREAD_HIST_SUB_BITS)
+
+/*
+ * struct uthread_hist - Histogram of values
+ * @count: Number of recorded values
+ * @min: Smallest recorded value, 0 if none
+ * @max: Largest recorded value
+ * @sum: Sum of recorded values
+ * @buckets: Number of values recorded in each bucket
+ */
+struct uthread_hist {
+	unsigned long count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+	unsigned long buckets[UTHREAD_HIST_BUCKETS];
+};
+
+/*
+ * uthread_hist_percentile - Get percentile of histogram
+ * @hist: Histogram
+ * @p: Percentile, between 0 and 100
+ *
+ * Return: Highest value of the bucket holding the @p-th percentile, capped by
+ * the largest recorded value. 0 if @hist is NULL or empty.
+ */
+uint64_t uthread_hist_percentile(const struct uthread_hist *hist, double p);
+
+/*
+ * uthread_latency - Get scheduler latency histograms
+ * @ready_delay: Address where to store the histogram of ready-to-run delays,
+ *	in nanoseconds, or NULL
+ * @quantum_use: Address where to store the histogram of quantum utilization,
+ *	in percent, or NULL
+ *
+ * Return: -1 if the library doesn't collect statistics. 0 otherwise.
+ */
+int uthread_latency(struct uthread_hist *ready_delay,
+		    struct uthread_hist *quantum_use);
+
+/*
+ * uthread_latency_report - Print summary of scheduler latency histograms
+ * @out: Stream where to print the summary
+ *
+ * Print the count, minimum, a few percentiles and maximum of both histograms.
+ *
+ * Return: -1 if the library doesn't collect statistics or if @out is NULL. 0
+ * otherwise.
+ */
+int uthread_latency_report(FILE *out);
+
+/*
+ * uthread_latency_report_every - Print summary periodically
+ * @period_ms: Period in milliseconds, 0 to stop printing
+ * @out: Stream where to print the summary
+ *
+ * The summary is printed by the idle thread, so it may come late while other
+ * threads keep running without being preempted. May be called before
+ * uthread_run(); printing stops when uthread_run() returns.
+ *
+ * Return: -1 if the library doesn't collect statistics, if @out is NULL while
+ * @period_ms isn't 0, or in case of memory allocation error. 0 otherwise.
+ */
+int uthread_latency_report_every(unsigned long period_ms, FILE *out);
+
+/*
+ * uthread_latency_reset - Empty scheduler latency histograms
+ */
+void uthread_latency_reset(void);
+
+#endif /* _LATENCY_H */
@@ -0,0 +1,171 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "lfqueue.h"
+
+/* Size of a cache line, to keep producer and consumer positions apart */
+#define LFQUEUE_CACHELINE 64
+
+/*
+ * Cell of the ring buffer
+ *
+ * For position pos of the cell, the sequence number is pos when the cell is
+ * free to be written, pos + 1 once it holds an item, and pos + capacity once
+ * the item has been read, i.e. when the cell is free for the next lap.
+ */
+struct lfqueue_cell {
+	_Atomic size_t seq;
+	void *data;
+};
+
+struct lfqueue {
+	_Alignas(LFQUEUE_CACHELINE) _Atomic size_t tail;	/* Next push */
+	_Alignas(LFQUEUE_CACHELINE) _Atomic size_t head;	/* Next pop */
+	_Alignas(LFQUEUE_CACHELINE) size_t mask;
+	struct lfqueue_cell *cells;
+};
+
+lfqueue_t lfqueue_create(size_t capacity)
+{
+	size_t size = 1, i;
+	lfqueue_t queue;
+
+	if (capacity == 0)
+		return NULL;
+	while (size < capacity)
+		size <<= 1;
+
+	queue = aligned_alloc(LFQUEUE_CACHELINE, sizeof(struct lfqueue));
+	if (queue == NULL)
+		return NULL;
+	queue->cells = malloc(size * sizeof(struct lfqueue_cell));
+	if (queue->cells == NULL) {
+		free(queue);
+		return NULL;
+	}
+	for (i = 0; i < size; i++)
+		atomic_init(&queue->cells[i].seq, i);
+	queue->mask = size - 1;
+	atomic_init(&queue->tail, 0);
+	atomic_init(&queue->head, 0);
+
+	return queue;
+}
+
+int lfqueue_destroy(lfqueue_t queue)
+{
+	if (queue == NULL)
+		return -1;
+
+	free(queue->cells);
+	free(queue);
+
+	return 0;
+}
+
+/*
+ * lfqueue_claim - Claim a batch of consecutive positions
+ * @queue: Queue
+ * @counter: Position counter to advance (tail or head)
+ * @ready: Sequence number of a ready cell relative to its position: 0 for a
+ *	free cell when pushing, 1 for a full cell when popping
+ * @n: Maximum number of positions to claim
+ * @pos: Address where first claimed position is stored
+ *
+ * Return: Number of positions claimed, 0 if the first cell isn't ready
+ */
+static size_t lfqueue_claim(lfqueue_t queue, _Atomic size_t *counter,
+			    size_t ready, size_t n, size_t *pos)
+{
+	size_t first = atomic_load_explicit(counter, memory_order_relaxed);
+
+	while (1) {
+		size_t k = 0;
+
+		/* Count the ready cells from the first position onwards */
+		while (k < n) {
+			struct lfqueue_cell *cell =
+				&queue->cells[(first + k) & queue->mask];
+			size_t seq = atomic_load_explicit(&cell->seq,
+							  memory_order_acquire);
+			intptr_t diff = (intptr_t)(seq - (first + k + ready));
+
+			if (diff != 0) {
+				/* Cell not ready yet: queue full or empty */
+				if (diff < 0 || k > 0)
+					break;
+				/* Another thread claimed it: catch up */
+				first = atomic_load_explicit(counter,
+							     memory_order_relaxed);
+				continue;
+			}
+			k++;
+		}
+		if (k == 0)
+			return 0;
+
+		/* On failure, @first is updated with the current position */
+		if (atomic_compare_exchange_weak_explicit(counter, &first,
+							  first + k,
+							  memory_order_relaxed,
+							  memory_order_relaxed)) {
+			*pos = first;
+			return k;
+		}
+	}
+}
+
+int lfqueue_try_push(lfqueue_t queue, void *data)
+{
+	return lfqueue_try_push_bulk(queue, &data, 1) == 1 ? 0 : -1;
+}
+
+int lfqueue_try_pop(lfqueue_t queue, void **data)
+{
+	return lfqueue_try_pop_bulk(queue, data, 1) == 1 ? 0 : -1;
+}
+
+int lfqueue_try_push_bulk(lfqueue_t queue, void **items, size_t n)
+{
+	size_t pos, k, i;
+
+	if (queue == NULL || items == NULL)
+		return -1;
+
+	/* NULL items can't be told apart from failed pops */
+	for (k = 0; k < n && items[k] != NULL; k++)
+		;
+	k = lfqueue_claim(queue, &queue->tail, 0, k, &pos);
+
+	for (i = 0; i < k; i++) {
+		struct lfqueue_cell *cell = &queue->cells[(pos + i) & queue->mask];
+
+		cell->data = items[i];
+		atomic_store_explicit(&cell->seq, pos + i + 1,
+				      memory_order_release);
+	}
+
+	return k;
+}
+
+int lfqueue_try_pop_bulk(lfqueue_t queue, void **out, size_t max)
+{
+	size_t pos, k, i;
+
+	if (queue == NULL || out == NULL)
+		return -1;
+
+	k = lfqueue_claim(queue, &queue->head, 1, max, &pos);
+
+	for (i = 0; i < k; i++) {
+		struct lfqueue_cell *cell = &queue->cells[(pos + i) & queue->mask];
+
+		out[i] = cell->data;
+		atomic_store_explicit(&cell->seq, pos + i + queue->mask + 1,
+				      memory_order_release);
+	}
+
+	return k;
+}
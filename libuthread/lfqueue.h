@@ -0,0 +1,91 @@
+#ifndef _LFQUEUE_H
+#define _LFQUEUE_H
+
+#include <stddef.h>
+
+/*
+ * lfqueue_t - Lock-free queue type
+ *
+ * A lock-free queue is a bounded FIFO of data item addresses which can be used
+ * concurrently by any number of OS threads, both for enqueueing and for
+ * dequeueing, without any lock. Unlike queue_t, it never allocates memory past
+ * its creation: operations fail instead of blocking or growing when the queue
+ * is full or empty.
+ *
+ * The queue is a ring buffer of cells, each with a sequence number telling
+ * whether the cell is ready to be written or read at a given position (after
+ * Dmitry Vyukov's bounded MPMC queue). Producers and consumers only contend on
+ * their own position counter, which lives on its own cache line.
+ */
+typedef struct lfqueue *lfqueue_t;
+
+/*
+ * lfqueue_create - Allocate an empty lock-free queue
+ * @capacity: Maximum number of items in the queue, rounded up to a power of
+ *	two
+ *
+ * Return: Pointer to new empty queue. NULL if @capacity is 0 or in case of
+ * failure when allocating the new queue.
+ */
+lfqueue_t lfqueue_create(size_t capacity);
+
+/*
+ * lfqueue_destroy - Deallocate a lock-free queue
+ * @queue: Queue to deallocate
+ *
+ * Items still in @queue are discarded. No other thread may use @queue anymore.
+ *
+ * Return: -1 if @queue is NULL, 0 otherwise.
+ */
+int lfqueue_destroy(lfqueue_t queue);
+
+/*
+ * lfqueue_try_push - Enqueue data item if there is room
+ * @queue: Queue in which to enqueue item
+ * @data: Address of data item to enqueue
+ *
+ * Return: -1 if @queue or @data are NULL, or if @queue is full. 0 if @data was
+ * successfully enqueued in @queue.
+ */
+int lfqueue_try_push(lfqueue_t queue, void *data);
+
+/*
+ * lfqueue_try_pop - Dequeue data item if there is one
+ * @queue: Queue in which to dequeue item
+ * @data: Address of data pointer where item is received
+ *
+ * Return: -1 if @queue or @data are NULL, or if @queue is empty. 0 if @data
+ * was set with the oldest item available in @queue.
+ */
+int lfqueue_try_pop(lfqueue_t queue, void **data);
+
+/*
+ * lfqueue_try_push_bulk - Enqueue as many data items as there is room for
+ * @queue: Queue in which to enqueue items
+ * @items: Array of addresses of data items to enqueue
+ * @n: Number of items in @items
+ *
+ * Enqueue the first items of @items, in array order. The items enqueued by a
+ * single call are contiguous in @queue: items of other threads can't come in
+ * between. The batch is claimed with a single atomic operation.
+ *
+ * Return: -1 if @queue or @items are NULL. Number of items enqueued otherwise,
+ * which is less than @n if @queue got full or if an item is NULL.
+ */
+int lfqueue_try_push_bulk(lfqueue_t queue, void **items, size_t n);
+
+/*
+ * lfqueue_try_pop_bulk - Dequeue as many data items as available
+ * @queue: Queue in which to dequeue items
+ * @out: Array where items are received
+ * @max: Maximum number of items to dequeue
+ *
+ * Dequeue up to @max of the oldest items of @queue into @out, oldest first.
+ * The batch is claimed with a single atomic operation.
+ *
+ * Return: -1 if @queue or @out are NULL. Number of items assigned to @out
+ * otherwise, 0 if @queue is empty.
+ */
+int lfqueue_try_pop_bulk(lfqueue_t queue, void **out, size_t max);
+
+#endif /* _LFQUEUE_H */
@@ -0,0 +1,221 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pqueue.h"
+
+/* Number of children of each heap entry */
+#define PQUEUE_ARITY 4
+
+/* Default capacity of priority queues */
+#define PQUEUE_MIN 16
+
+/*
+ * Heap entry, holding a copy of the item key along with its insertion sequence
+ * number to order equal keys
+ */
+struct pqueue_entry {
+	uint64_t key;
+	uint64_t seq;
+	struct pqueue_node *node;
+};
+
+struct pqueue {
+	int count;
+	int capacity;
+	uint64_t seq;	/* Sequence number of next inserted item */
+	struct pqueue_entry *heap;
+};
+
+static bool entry_less(const struct pqueue_entry *a,
+		       const struct pqueue_entry *b)
+{
+	return a->key < b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+static void heap_set(pqueue_t pqueue, int i, struct pqueue_entry entry)
+{
+	pqueue->heap[i] = entry;
+	entry.node->index = i;
+}
+
+/* Move the entry at @i up while it is smaller than its parent */
+static void sift_up(pqueue_t pqueue, int i)
+{
+	struct pqueue_entry entry = pqueue->heap[i];
+
+	while (i > 0) {
+		int parent = (i - 1) / PQUEUE_ARITY;
+
+		if (!entry_less(&entry, &pqueue->heap[parent]))
+			break;
+		heap_set(pqueue, i, pqueue->heap[parent]);
+		i = parent;
+	}
+	heap_set(pqueue, i, entry);
+}
+
+/* Move the entry at @i down while one of its children is smaller */
+static void sift_down(pqueue_t pqueue, int i)
+{
+	struct pqueue_entry entry = pqueue->heap[i];
+
+	while (1) {
+		int first = i * PQUEUE_ARITY + 1, last, child, min;
+
+		if (first >= pqueue->count)
+			break;
+		last = first + PQUEUE_ARITY;
+		if (last > pqueue->count)
+			last = pqueue->count;
+
+		/* The children of an entry are contiguous */
+		min = first;
+		for (child = first + 1; child < last; child++)
+			if (entry_less(&pqueue->heap[child], &pqueue->heap[min]))
+				min = child;
+		if (!entry_less(&pqueue->heap[min], &entry))
+			break;
+		heap_set(pqueue, i, pqueue->heap[min]);
+		i = min;
+	}
+	heap_set(pqueue, i, entry);
+}
+
+/* Remove the entry at @i, replacing it with the last entry */
+static void heap_remove(pqueue_t pqueue, int i)
+{
+	struct pqueue_node *node = pqueue->heap[i].node;
+
+	pqueue->count--;
+	if (i != pqueue->count) {
+		heap_set(pqueue, i, pqueue->heap[pqueue->count]);
+		if (i > 0 && entry_less(&pqueue->heap[i],
+					&pqueue->heap[(i - 1) / PQUEUE_ARITY]))
+			sift_up(pqueue, i);
+		else
+			sift_down(pqueue, i);
+	}
+	node->index = -1;
+}
+
+pqueue_t pqueue_create(int capacity_hint)
+{
+	pqueue_t pqueue = malloc(sizeof(struct pqueue));
+
+	if (pqueue == NULL)
+		return NULL;
+
+	pqueue->capacity = PQUEUE_MIN;
+	while (pqueue->capacity < capacity_hint)
+		pqueue->capacity *= 2;
+	pqueue->heap = malloc(pqueue->capacity * sizeof(struct pqueue_entry));
+	if (pqueue->heap == NULL) {
+		free(pqueue);
+		return NULL;
+	}
+	pqueue->count = 0;
+	pqueue->seq = 0;
+
+	return pqueue;
+}
+
+int pqueue_destroy(pqueue_t pqueue)
+{
+	if (pqueue == NULL || pqueue->count != 0)
+		return -1;
+
+	free(pqueue->heap);
+	free(pqueue);
+
+	return 0;
+}
+
+int pqueue_contains(pqueue_t pqueue, struct pqueue_node *node)
+{
+	if (pqueue == NULL || node == NULL)
+		return -1;
+
+	/* The index of a node that isn't in the queue may be anything */
+	return node->index >= 0 && node->index < pqueue->count &&
+		pqueue->heap[node->index].node == node;
+}
+
+int pqueue_insert(pqueue_t pqueue, struct pqueue_node *node, uint64_t key)
+{
+	if (pqueue == NULL || node == NULL || pqueue_contains(pqueue, node))
+		return -1;
+
+	if (pqueue->count == pqueue->capacity) {
+		struct pqueue_entry *heap = realloc(pqueue->heap,
+			2 * pqueue->capacity * sizeof(struct pqueue_entry));
+
+		if (heap == NULL)
+			return -1;
+		pqueue->heap = heap;
+		pqueue->capacity *= 2;
+	}
+
+	node->key = key;
+	pqueue->heap[pqueue->count] = (struct pqueue_entry) {
+		.key = key,
+		.seq = pqueue->seq++,
+		.node = node,
+	};
+	sift_up(pqueue, pqueue->count++);
+
+	return 0;
+}
+
+int pqueue_peek(pqueue_t pqueue, struct pqueue_node **node)
+{
+	if (pqueue == NULL || node == NULL || pqueue->count == 0)
+		return -1;
+
+	*node = pqueue->heap[0].node;
+
+	return 0;
+}
+
+int pqueue_pop(pqueue_t pqueue, struct pqueue_node **node)
+{
+	if (pqueue_peek(pqueue, node))
+		return -1;
+
+	heap_remove(pqueue, 0);
+
+	return 0;
+}
+
+int pqueue_decrease_key(pqueue_t pqueue, struct pqueue_node *node,
+			uint64_t key)
+{
+	if (pqueue_contains(pqueue, node) != 1 || key > node->key)
+		return -1;
+
+	node->key = key;
+	pqueue->heap[node->index].key = key;
+	pqueue->heap[node->index].seq = pqueue->seq++;
+	sift_up(pqueue, node->index);
+
+	return 0;
+}
+
+int pqueue_delete(pqueue_t pqueue, struct pqueue_node *node)
+{
+	if (pqueue_contains(pqueue, node) != 1)
+		return -1;
+
+	heap_remove(pqueue, node->index);
+
+	return 0;
+}
+
+int pqueue_length(pqueue_t pqueue)
+{
+	if (pqueue == NULL)
+		return -1;
+
+	return pqueue->count;
+}
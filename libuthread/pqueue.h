@@ -0,0 +1,141 @@
+#ifndef _PQUEUE_H
+#define _PQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * pqueue_t - Priority queue type
+ *
+ * A priority queue orders items by key: the item with the smallest key is
+ * always the first one to be removed. Items with equal keys are removed in
+ * insertion order.
+ *
+ * Items are intrusive: they embed a struct pqueue_node, which serves as a
+ * handle to find them in the queue, so that inserting an item never allocates
+ * memory except for growing the queue. The queue itself is a 4-ary heap stored
+ * in an array, which also keeps a copy of the keys so that reordering the heap
+ * doesn't have to access the items.
+ *
+ * Insert, pop, decrease-key and delete are O(log n), peek is O(1).
+ */
+typedef struct pqueue *pqueue_t;
+
+/*
+ * struct pqueue_node - Priority queue handle
+ * @key: Key of item, set when inserting the item. Read-only
+ * @index: Position of item in the queue. Private
+ *
+ * To be embedded in the items of a priority queue. The item embedding a node
+ * can be retrieved with pqueue_entry().
+ */
+struct pqueue_node {
+	uint64_t key;
+	int index;
+};
+
+/*
+ * pqueue_entry - Get item embedding a priority queue node
+ * @node: Address of node
+ * @type: Type of item
+ * @member: Name of node within @type
+ */
+#define pqueue_entry(node, type, member) \
+	((type *)((char *)(node) - offsetof(type, member)))
+
+/*
+ * pqueue_create - Allocate an empty priority queue
+ * @capacity_hint: Expected maximum number of items in the queue
+ *
+ * The queue grows by doubling its size whenever it is full.
+ *
+ * Return: Pointer to new empty priority queue. NULL in case of failure when
+ * allocating the new queue.
+ */
+pqueue_t pqueue_create(int capacity_hint);
+
+/*
+ * pqueue_destroy - Deallocate a priority queue
+ * @pqueue: Priority queue to deallocate
+ *
+ * Return: -1 if @pqueue is NULL or if @pqueue is not empty. 0 if @pqueue was
+ * successfully destroyed.
+ */
+int pqueue_destroy(pqueue_t pqueue);
+
+/*
+ * pqueue_insert - Insert item
+ * @pqueue: Priority queue in which to insert item
+ * @node: Node of item to insert
+ * @key: Key of item
+ *
+ * Return: -1 if @pqueue or @node are NULL, if @node is already in @pqueue, or
+ * in case of memory allocation error when growing @pqueue. 0 if the item was
+ * successfully inserted.
+ */
+int pqueue_insert(pqueue_t pqueue, struct pqueue_node *node, uint64_t key);
+
+/*
+ * pqueue_peek - Get item with smallest key
+ * @pqueue: Priority queue in which to look for item
+ * @node: Address of node pointer where item is received
+ *
+ * Return: -1 if @pqueue or @node are NULL, or if @pqueue is empty. 0 if @node
+ * was set with the item of smallest key.
+ */
+int pqueue_peek(pqueue_t pqueue, struct pqueue_node **node);
+
+/*
+ * pqueue_pop - Remove item with smallest key
+ * @pqueue: Priority queue in which to remove item
+ * @node: Address of node pointer where item is received
+ *
+ * Return: -1 if @pqueue or @node are NULL, or if @pqueue is empty. 0 if @node
+ * was set with the item of smallest key, which was removed from @pqueue.
+ */
+int pqueue_pop(pqueue_t pqueue, struct pqueue_node **node);
+
+/*
+ * pqueue_decrease_key - Decrease key of item
+ * @pqueue: Priority queue of item
+ * @node: Node of item
+ * @key: New key of item
+ *
+ * An item whose key is decreased to the key of other items comes after them.
+ *
+ * Return: -1 if @pqueue or @node are NULL, if @node is not in @pqueue, or if
+ * @key is greater than the current key of the item. 0 if the key was
+ * successfully decreased.
+ */
+int pqueue_decrease_key(pqueue_t pqueue, struct pqueue_node *node,
+			uint64_t key);
+
+/*
+ * pqueue_delete - Delete item
+ * @pqueue: Priority queue in which to delete item
+ * @node: Node of item to delete
+ *
+ * Return: -1 if @pqueue or @node are NULL, or if @node is not in @pqueue. 0 if
+ * the item was deleted from @pqueue.
+ */
+int pqueue_delete(pqueue_t pqueue, struct pqueue_node *node);
+
+/*
+ * pqueue_contains - Look for item
+ * @pqueue: Priority queue in which to look for item
+ * @node: Node of item to look for
+ *
+ * Return: -1 if @pqueue or @node are NULL. 1 if @node is in @pqueue, 0
+ * otherwise.
+ */
+int pqueue_contains(pqueue_t pqueue, struct pqueue_node *node);
+
+/*
+ * pqueue_length - Priority queue length
+ * @pqueue: Priority queue to get the length of
+ *
+ * Return: -1 if @pqueue is NULL. Number of items in @pqueue otherwise.
+ */
+int pqueue_length(pqueue_t pqueue);
+
+#endif /* _PQUEUE_H */
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -5,76 +6,413 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "private.h"
 #include "uthread.h"
 
-/*
- * Frequency of preemption
- * 100Hz is 100 times per second
- */
-#define HZ 100
 #define MICROSEC 1000000
 
+/* Not defined by older C libraries */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 static struct sigaction sa, prev_sa;
 static struct itimerval it, prev_it;
 static sigset_t ss, prev_ss;
 
+/* Clock driving preemption, and its timer and signal */
+static int preempt_clock = -1;
+static timer_t preempt_timer;
+static int preempt_signo;
+
+/* Signal blocked along with the timer signal, 0 for none */
+static int preempt_deferred_signo;
+
+/* Length of a time slice, in microseconds */
+static unsigned long preempt_quantum;
+
+/*
+ * Tickless preemption state
+ *
+ * The timer is one-shot and only armed while a thread other than the running
+ * one is runnable. It is not cancelled when a thread yields before the end of
+ * its slice: slices are counted instead, so that a timer armed during an
+ * earlier slice gets rearmed for a full slice when it expires.
+ */
+static bool preempt_armed;
+static bool preempt_wanted;     // whether current slice must end on expiry
+static unsigned long preempt_slice, preempt_armed_slice;
+
+/*
+ * Profiling state
+ *
+ * While profiling, the timer fires every sampling period, whether other
+ * threads are runnable or not, and a slice ends once it lasted a quantum worth
+ * of sampling periods.
+ */
+static unsigned long preempt_profile_period;    // 0 when not profiling
+static unsigned long preempt_slice_used;
+
+/*
+ * Tick state
+ *
+ * A tick is counted each time a thread other than the idle thread enters a
+ * critical section of the library, i.e. on each outermost preempt_disable().
+ * Ticks are counted with the tick clock, which preempts threads after a
+ * number of ticks rather than with a timer signal, and while recording or
+ * replaying scheduler decisions, which identify preemption points by the
+ * number of ticks into the slice.
+ */
+static bool preempt_counting;
+static bool preempt_off;                // whether preemption is disabled
+static unsigned long preempt_ticks;     // ticks into current slice
+static unsigned long preempt_slice_ticks;       // length of current slice
+static uint64_t preempt_seed, preempt_rand;
+
+/* Interval timer of process CPU time clocks */
+static int preempt_itimer(void)
+{
+        return preempt_clock == UTHREAD_CLOCK_PROF ? ITIMER_PROF : ITIMER_VIRTUAL;
+}
+
+/* Fire the preemption timer once, a time slice from now */
+static int preempt_arm(void)
+{
+        /* Configure a timer to fire alarm
+         * it_interval: 0 for a one-shot timer
+         * it_value: time until next expiration
+         * tv_sec: seconds
+         * tv_usec: microseconds
+         * 1000000 microseconds in a second */
+        unsigned long period = preempt_profile_period ?
+                preempt_profile_period : preempt_quantum;
+
+        it.it_interval.tv_sec = 0;
+        it.it_interval.tv_usec = 0;
+        it.it_value.tv_sec = period / MICROSEC;
+        it.it_value.tv_usec = period % MICROSEC;
+
+        preempt_armed = true;
+        preempt_armed_slice = preempt_slice;
+
+        if (preempt_clock == UTHREAD_CLOCK_MONOTONIC) {
+                struct itimerspec its = {
+                        .it_value.tv_sec = it.it_value.tv_sec,
+                        .it_value.tv_nsec = it.it_value.tv_usec * 1000,
+                };
+
+                return timer_settime(preempt_timer, 0, &its, NULL);
+        }
+
+        return setitimer(preempt_itimer(), &it, NULL);
+}
+
+/* Length of next slice in ticks: the quantum, or random up to it if seeded */
+static unsigned long preempt_draw_slice(void)
+{
+        if (preempt_seed == 0) {
+                return preempt_quantum;
+        }
+
+        /* xorshift64* */
+        preempt_rand ^= preempt_rand >> 12;
+        preempt_rand ^= preempt_rand << 25;
+        preempt_rand ^= preempt_rand >> 27;
+
+        return 1 + (preempt_rand * 2685821657736338717ULL) % preempt_quantum;
+}
+
+/* Whether the slice of the running thread is over at the current tick */
+static bool preempt_slice_over(void)
+{
+        long target;
+
+        /* Replayed preemption points override the tick clock */
+        if (replay_mode == REPLAY_MODE_PLAY) {
+                target = replay_preempt_ticks();
+                return target >= 0 && preempt_ticks >= (unsigned long)target;
+        }
+
+        return preempt_clock == UTHREAD_CLOCK_TICKS && preempt_wanted &&
+                preempt_ticks >= preempt_slice_ticks;
+}
+
+/*
+ * preempt_tick - Count tick of running thread
+ *
+ * Preempt the running thread first while its slice is over. A slice of n
+ * ticks thus lets a thread enter the library n times, and a preemption point
+ * is the number of ticks counted before it, whether the thread was preempted
+ * by a tick or by a timer signal. Must be called with the timer signal
+ * blocked, which it is again on return.
+ */
+static void preempt_tick(void)
+{
+        if (uthread_idle()) {
+                return;
+        }
+
+        while (preempt_slice_over()) {
+                /* Don't count the ticks of switching out, the next thread
+                 * enables preemption again */
+                preempt_off = true;
+                trace_record(TRACE_PREEMPT, uthread_self(), 0);
+                uthread_preempt();
+                sigprocmask(SIG_BLOCK, &ss, NULL);
+        }
+        preempt_ticks++;
+}
+
+unsigned long preempt_get_ticks(void)
+{
+        return preempt_ticks;
+}
+
 void preempt_disable(void)
 {
         /* TODO Phase 4 */
         sigprocmask(SIG_BLOCK, &ss, NULL);
+
+        /* Count tick once the timer signal can't preempt the thread anymore,
+         * so that a recorded preemption always follows the ticks counted */
+        if (preempt_counting && !preempt_off) {
+                preempt_tick();
+        }
+        preempt_off = true;
 }
 
 void preempt_enable(void)
 {
         /* TODO Phase 4 */
+        preempt_off = false;
         sigprocmask(SIG_UNBLOCK, &ss, NULL);
 }
 
-void sig_handler(int signum) {
-        if(signum == SIGVTALRM) {
-                uthread_yield();
+void sig_handler(int signum, siginfo_t *info, void *ucontext) {
+        (void)info;
+        if(signum == preempt_signo) {
+                preempt_armed = false;
+
+                /* Sample running thread, and keep ticking until its slice
+                 * lasted a full quantum */
+                if (preempt_profile_period) {
+                        profile_sample(ucontext);
+                        if (preempt_armed_slice == preempt_slice) {
+                                preempt_slice_used += preempt_profile_period;
+                        }
+                        if (!preempt_wanted ||
+                            preempt_slice_used < preempt_quantum) {
+                                preempt_arm();
+                                return;
+                        }
+                }
+
+                /* Nothing else to run: stay disarmed */
+                if (!preempt_wanted) {
+                        return;
+                }
+                /* While recording, the idle thread yields on its own rather
+                 * than at a point which couldn't be replayed */
+                if (replay_mode == REPLAY_MODE_RECORD && uthread_idle()) {
+                        preempt_arm();
+                        return;
+                }
+                /* Timer was armed during an earlier slice */
+                if (preempt_armed_slice != preempt_slice) {
+                        preempt_arm();
+                        return;
+                }
+                /* Switching out isn't a tick of the preempted thread */
+                preempt_off = true;
+                trace_record(TRACE_PREEMPT, uthread_self(), 0);
+                uthread_preempt();
+        }
+}
+
+void preempt_slice_start(bool others_ready)
+{
+        preempt_ticks = 0;
+        if (preempt_clock == -1) {
+                return;
+        }
+        if (preempt_clock == UTHREAD_CLOCK_TICKS) {
+                preempt_wanted = others_ready;
+                preempt_slice_ticks = preempt_draw_slice();
+                return;
+        }
+
+        preempt_slice++;
+        preempt_slice_used = 0;
+        preempt_wanted = others_ready;
+        if ((others_ready || preempt_profile_period) && !preempt_armed) {
+                preempt_arm();
         }
 }
 
-void preempt_start(bool preempt)
+void preempt_ready(void)
+{
+        if (preempt_clock == -1 || preempt_wanted) {
+                return;
+        }
+
+        preempt_wanted = true;
+        if (!preempt_armed && preempt_clock != UTHREAD_CLOCK_TICKS) {
+                preempt_arm();
+        }
+}
+
+void preempt_start(bool preempt, int clock, unsigned long quantum_us,
+                   uint64_t seed)
 {
         /* TODO Phase 4 */
+        preempt_ticks = 0;
+        preempt_counting = replay_mode != REPLAY_MODE_OFF ||
+                (preempt && clock == UTHREAD_CLOCK_TICKS);
+
+        /* Replayed runs are only preempted where the recorded run was */
+        if (replay_mode == REPLAY_MODE_PLAY) {
+                preempt = true;
+                clock = UTHREAD_CLOCK_TICKS;
+                seed = 0;
+        }
+        if (preempt && clock == UTHREAD_CLOCK_TICKS) {
+                preempt_clock = clock;
+                preempt_quantum = quantum_us;
+                preempt_seed = seed;
+                preempt_rand = seed;
+                preempt_wanted = false;
+                preempt_slice_ticks = preempt_draw_slice();
+                return;
+        }
         if (preempt) {
-                /* 1. Set up signal handler that recieves alarm signals */
-                sa.sa_handler = sig_handler;
+                preempt_clock = clock;
+                switch (clock) {
+                case UTHREAD_CLOCK_PROF:
+                        preempt_signo = SIGPROF;
+                        break;
+                case UTHREAD_CLOCK_MONOTONIC:
+                        preempt_signo = SIGALRM;
+                        break;
+                default:
+                        preempt_signo = SIGVTALRM;
+                        break;
+                }
+
+                /* 1. Set up signal handler that recieves alarm signals.
+                 * Wall-clock alarms may interrupt system calls, which are
+                 * restarted */
+                sa.sa_sigaction = sig_handler;
                 sigemptyset(&sa.sa_mask);
-                sa.sa_flags = 0;
-                sigaction(SIGVTALRM, &sa, &prev_sa);
+                sa.sa_flags = SA_RESTART | SA_SIGINFO;
+                sigaction(preempt_signo, &sa, &prev_sa);
 
                 /* Set up block and unblocking signals */
                 sigemptyset(&ss);
-                sigaddset(&ss, SIGVTALRM);
+                sigaddset(&ss, preempt_signo);
+                if (preempt_deferred_signo) {
+                        sigaddset(&ss, preempt_deferred_signo);
+                }
                 sigprocmask(SIG_SETMASK, NULL, &prev_ss);
 
-                /* 2. Configure a timer to fire alarm 
-                 * it_interval: interval for periodic timer 
-                 * it_value: time until next expiration
-                 * tv_sec: seconds 
-                 * tv_usec: microseconds 
-                 * 1000000 microseconds in a second */
-                it.it_interval.tv_sec = 0;
-                it.it_interval.tv_usec = MICROSEC / HZ;
-                it.it_value.tv_sec = 0;
-                it.it_value.tv_usec = MICROSEC / HZ;
-
-                if (setitimer(ITIMER_VIRTUAL, &it, &prev_it) == -1) {
-                        perror("setitimer");
-                        exit(1);
+                /* 2. Create the timer: monotonic clock alarms are directed
+                 * to this OS thread rather than to the whole process */
+                if (clock == UTHREAD_CLOCK_MONOTONIC) {
+                        struct sigevent sev = {
+                                .sigev_notify = SIGEV_THREAD_ID,
+                                .sigev_signo = preempt_signo,
+                        };
+
+                        sev.sigev_notify_thread_id = gettid();
+                        if (timer_create(CLOCK_MONOTONIC, &sev, &preempt_timer) == -1) {
+                                perror("timer_create");
+                                exit(1);
+                        }
+                } else {
+                        getitimer(preempt_itimer(), &prev_it);
+                }
+
+                /* The timer is armed once another thread becomes ready,
+                 * or right away when profiling */
+                preempt_quantum = quantum_us;
+                preempt_armed = false;
+                preempt_wanted = false;
+                if (preempt_profile_period) {
+                        preempt_arm();
                 }
         }
 }
 
+int preempt_set_profile(unsigned long period_us)
+{
+        /* Sampling needs a timer */
+        if (preempt_clock == UTHREAD_CLOCK_TICKS && period_us) {
+                return -1;
+        }
+        preempt_profile_period = period_us;
+        if (preempt_clock == -1 || period_us == 0 || preempt_armed) {
+                return 0;
+        }
+
+        return preempt_arm();
+}
+
+int preempt_set_quantum(unsigned long quantum_us)
+{
+        if (preempt_clock == -1) {
+                return -1;
+        }
+
+        preempt_quantum = quantum_us;
+        if (!preempt_armed || preempt_clock == UTHREAD_CLOCK_TICKS) {
+                return 0;
+        }
+
+        return preempt_arm();
+}
+
+void preempt_defer_signal(int signo)
+{
+        if (preempt_deferred_signo) {
+                sigdelset(&ss, preempt_deferred_signo);
+        }
+        preempt_deferred_signo = signo;
+        if (signo) {
+                sigaddset(&ss, signo);
+        }
+}
+
+unsigned long preempt_get_quantum(void)
+{
+        if (preempt_clock == -1 || preempt_clock == UTHREAD_CLOCK_TICKS) {
+                return 0;
+        }
+
+        return preempt_quantum;
+}
+
 void preempt_stop(void)
 {
         /* TODO Phase 4 */
-        setitimer(SIGVTALRM, &prev_it, NULL);
-        sigaction(SIGVTALRM, &prev_sa, NULL);
+        preempt_counting = false;
+        if (preempt_clock == -1) {
+                return;
+        }
+        if (preempt_clock == UTHREAD_CLOCK_TICKS) {
+                preempt_clock = -1;
+                preempt_wanted = false;
+                return;
+        }
+        if (preempt_clock == UTHREAD_CLOCK_MONOTONIC) {
+                timer_delete(preempt_timer);
+        } else {
+                setitimer(preempt_itimer(), &prev_it, NULL);
+        }
+        sigaction(preempt_signo, &prev_sa, NULL);
         sigprocmask(SIG_SETMASK, &prev_ss, NULL);
+        preempt_clock = -1;
+        preempt_armed = false;
+        preempt_wanted = false;
 }
\ No newline at end of file
@@ -10,8 +10,12 @@
 /**
  * Private context API
  */
+#include <stdbool.h>
+#include <stdint.h>
 #include <ucontext.h>
 
+#include "pqueue.h"
+#include "queue.h"
 #include "uthread.h"
 
 /*
@@ -42,6 +46,15 @@ void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next);
  */
 void *uthread_ctx_alloc_stack(void);
 
+/*
+ * uthread_ctx_stack_used - Measure high-water mark of watched stack
+ * @top_of_stack: Address of stack, as allocated by uthread_ctx_alloc_stack()
+ *	while stack watching was enabled
+ *
+ * Return: Number of bytes of the stack which were used at some point
+ */
+size_t uthread_ctx_stack_used(void *top_of_stack);
+
 /*
  * uthread_ctx_destroy_stack - Deallocate stack segment
  * @top_of_stack: Address of stack to deallocate
@@ -69,14 +82,94 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 /*
  * preempt_start - Start thread preemption
  * @preempt: Enable preemption if true
+ * @clock: Clock measuring time slices, one of the UTHREAD_CLOCK_* values
+ * @quantum_us: Length of a time slice, in microseconds, or in ticks with
+ *	UTHREAD_CLOCK_TICKS
+ * @seed: Seed of the random slice lengths with UTHREAD_CLOCK_TICKS, 0 for
+ *	slices of exactly @quantum_us ticks
  *
- * Configure a timer that must fire a virtual alarm at a frequency of 100 Hz and
- * setup a timer handler that forcefully yields the currently running thread.
+ * Configure a one-shot timer that fires an alarm @quantum_us microseconds of
+ * @clock into a time slice and setup a timer handler that forcefully yields the
+ * currently running thread. The timer is only armed while another thread is
+ * runnable (see preempt_slice_start() and preempt_ready()). With
+ * UTHREAD_CLOCK_TICKS, no timer is used: the running thread is preempted from
+ * preempt_disable() once its slice lasted enough ticks.
+ *
+ * While replaying scheduler decisions, threads are preempted at the recorded
+ * ticks instead, whatever @preempt and @clock.
  *
  * If @preempt is false, don't start preemption; all the other functions from
  * the preemption API should then be ineffective.
  */
-void preempt_start(bool preempt);
+void preempt_start(bool preempt, int clock, unsigned long quantum_us,
+		   uint64_t seed);
+
+/*
+ * preempt_get_ticks - Get number of ticks into current slice
+ *
+ * Only counted with UTHREAD_CLOCK_TICKS, or while recording or replaying
+ * scheduler decisions.
+ */
+unsigned long preempt_get_ticks(void);
+
+/*
+ * preempt_set_quantum - Change length of time slices
+ * @quantum_us: New length of a time slice, in microseconds
+ *
+ * The current time slice is restarted with the new length.
+ *
+ * Return: -1 if preemption is not started or in case of failure when
+ * rearming the timer, 0 otherwise
+ */
+int preempt_set_quantum(unsigned long quantum_us);
+
+/*
+ * preempt_get_quantum - Get length of time slices
+ *
+ * Return: Length of time slices in microseconds, 0 if preemption is not
+ * started or not driven by a timer
+ */
+unsigned long preempt_get_quantum(void);
+
+/*
+ * preempt_slice_start - Start time slice of newly running thread
+ * @others_ready: Whether other threads are runnable
+ *
+ * Arm the timer if @others_ready is true and the timer isn't armed already;
+ * otherwise the thread runs without being preempted. Must be called with
+ * preemption disabled, on each context switch.
+ */
+void preempt_slice_start(bool others_ready);
+
+/*
+ * preempt_ready - Notify that a thread became runnable
+ *
+ * Arm the timer if the running thread was alone so far. Must be called with
+ * preemption disabled.
+ */
+void preempt_ready(void);
+
+/*
+ * preempt_set_profile - Change sampling period of the profiler
+ * @period_us: Sampling period, in microseconds, or 0 to stop sampling
+ *
+ * While sampling, the timer fires every @period_us microseconds and calls
+ * profile_sample(), even if no other thread is runnable. Time slices are then
+ * counted in sampling periods. Takes effect on the next preempt_start() if
+ * preemption is not started. Must be called with preemption disabled.
+ *
+ * Return: -1 in case of failure when arming the timer, 0 otherwise
+ */
+int preempt_set_profile(unsigned long period_us);
+
+/*
+ * preempt_defer_signal - Defer another signal while preemption is disabled
+ * @signo: Signal to block along with the timer signal, 0 for none
+ *
+ * Replaces the signal given in the previous call, if any. Must be called with
+ * preemption enabled.
+ */
+void preempt_defer_signal(int signo);
 
 /*
  * preempt_stop - Stop thread preemption
@@ -97,6 +190,117 @@ void preempt_enable(void);
 void preempt_disable(void);
 
 
+/**
+ * Private timer API
+ *
+ * Timers are driven by the idle thread, which fires expired timers each time it
+ * is scheduled and sleeps until the next deadline when no thread is ready. All
+ * functions but timer_run() and timer_next() must be called with preemption
+ * disabled.
+ */
+
+/*
+ * uthread_timer - One-shot timer
+ *
+ * Timers are allocated by their users, typically on the stack of the thread
+ * waiting for them, and armed timers are kept in a priority queue ordered by
+ * deadline. Arming a timer only allocates memory when the queue grows.
+ */
+struct uthread_timer {
+	struct pqueue_node node;	/* Deadline is the key */
+	void (*func)(void *arg);
+	void *arg;
+};
+
+/*
+ * timer_now - Get current time
+ *
+ * Return: Current time of the monotonic clock, in nanoseconds
+ */
+uint64_t timer_now(void);
+
+/*
+ * timer_start - Arm timer
+ * @timer: Timer to arm
+ * @deadline: Expiration time, in nanoseconds of the monotonic clock
+ * @func: Function to call when @timer expires
+ * @arg: Argument to pass to @func
+ *
+ * @func is called from the idle thread, with preemption disabled. It may
+ * enable preemption again, e.g. by unblocking a thread.
+ *
+ * Return: -1 in case of memory allocation error, 0 otherwise
+ */
+int timer_start(struct uthread_timer *timer, uint64_t deadline,
+		void (*func)(void *arg), void *arg);
+
+/*
+ * timer_cancel - Disarm timer
+ * @timer: Timer to disarm, which may have already expired
+ */
+void timer_cancel(struct uthread_timer *timer);
+
+/*
+ * timer_run - Fire expired timers
+ */
+void timer_run(void);
+
+/*
+ * timer_next - Get next timer deadline
+ * @deadline: Address where to store the deadline of the next timer to expire
+ *
+ * Return: -1 if no timer is armed, 0 otherwise
+ */
+int timer_next(uint64_t *deadline);
+
+
+/**
+ * Private external request API
+ *
+ * Other OS threads post requests into a lock-free inbox and kick an event
+ * counter. The idle thread processes requests in batches, and sleeps on the
+ * event counter when no thread is ready.
+ */
+
+/*
+ * external_start - Open inbox for requests
+ *
+ * Return: 0 in case of success, -1 in case of failure
+ */
+int external_start(void);
+
+/*
+ * external_stop - Close inbox, discarding pending requests
+ */
+void external_stop(void);
+
+/*
+ * external_run - Process pending requests
+ */
+void external_run(void);
+
+/*
+ * external_pending - Check for pending requests
+ *
+ * Return: true if requests were posted since external_run() last ran
+ */
+bool external_pending(void);
+
+/*
+ * external_expected - Check whether requests may still be posted
+ *
+ * Return: true if OS threads are attached or requests are pending
+ */
+bool external_expected(void);
+
+/*
+ * external_wait - Sleep until a request is posted
+ * @deadline: Time at which to wake up anyway, in nanoseconds of the monotonic
+ *	clock, or 0 to wait for a request indefinitely
+ */
+void external_wait(uint64_t deadline);
+
+
 /**
  * Private uthread API
  */
@@ -119,10 +323,297 @@ struct uthread_tcb *uthread_current(void);
  */
 void uthread_block(void);
 
+/*
+ * uthread_idle - Whether the idle thread is running
+ *
+ * Return: true if the idle thread is running, or if the library isn't running
+ */
+bool uthread_idle(void);
+
+/*
+ * uthread_set_wait - Record what the running thread is about to block on
+ * @what: Kind of object, as a string literal
+ * @obj: Address of object
+ *
+ * Only used to describe blocked threads in dumps. Must be called with
+ * preemption disabled, right before uthread_block().
+ */
+void uthread_set_wait(const char *what, const void *obj);
+
 /*
  * uthread_unblock - Unblock thread
  * @uthread: TCB of thread to unblock
  */
 void uthread_unblock(struct uthread_tcb *uthread);
 
+/*
+ * uthread_ready - Make blocked thread ready
+ * @uthread: TCB of thread to make ready
+ *
+ * Same as uthread_unblock(), for callers that already disabled preemption and
+ * wake several threads in the same critical section. Preemption is left
+ * disabled.
+ */
+void uthread_ready(struct uthread_tcb *uthread);
+
+/*
+ * uthread_unblock_all - Unblock every thread of a wait queue
+ * @queue: Queue of TCBs of blocked threads
+ *
+ * Empty @queue and make all the threads it contained ready, oldest first, in a
+ * single critical section.
+ */
+void uthread_unblock_all(queue_t queue);
+
+/*
+ * uthread_switch_to - Unblock thread and switch to it
+ * @uthread: TCB of blocked thread to switch to
+ *
+ * Unblock @uthread and immediately run it instead of the oldest ready thread.
+ * The currently running thread is put at the end of the ready queue, as if it
+ * had yielded.
+ */
+void uthread_switch_to(struct uthread_tcb *uthread);
+
+/*
+ * uthread_preempt - Preempt running thread
+ *
+ * Same as uthread_yield(), called from the timer handler so that the switch is
+ * accounted as a preemption.
+ */
+void uthread_preempt(void);
+
+/*
+ * struct uthread_info - Description of a thread, for dumps
+ * @tid: Identifier of thread
+ * @state: "running", "ready" or "blocked"
+ * @state_since: Time of last change of state, in nanoseconds of the monotonic
+ *	clock. Only kept up to date while state changes are timed
+ * @wait: Kind of object the thread is blocked on, NULL if unknown or if the
+ *	thread isn't blocked
+ * @wait_obj: Address of object the thread is blocked on
+ * @context: Saved context of thread, NULL for the running thread
+ * @stack_lo: Lowest address of the stack of thread, 0 for the idle thread
+ * @stack_hi: Address right above the stack of thread, 0 for the idle thread
+ */
+struct uthread_info {
+	uthread_t tid;
+	const char *state;
+	uint64_t state_since;
+	const char *wait;
+	const void *wait_obj;
+	const uthread_ctx_t *context;
+	uintptr_t stack_lo;
+	uintptr_t stack_hi;
+};
+
+/* Whether state changes are timed even without UTHREAD_STATS */
+extern bool dump_timed;
+
+/*
+ * uthread_inspect - Describe all threads
+ * @func: Function called with the description of each thread: the running
+ *	thread, then ready threads in the order they will run, then blocked
+ *	threads
+ *
+ * Must be called with preemption disabled. Only walks the scheduler queues,
+ * so that it can be called from a signal handler.
+ *
+ * Return: -1 if the library is not running, 0 otherwise
+ */
+int uthread_inspect(void (*func)(const struct uthread_info *info));
+
+/*
+ * uthread_stats_sem_wait - Count wait of running thread on a semaphore
+ *
+ * Compiled out unless UTHREAD_STATS is defined.
+ */
+#ifdef UTHREAD_STATS
+void uthread_stats_sem_wait(void);
+#else
+static inline void uthread_stats_sem_wait(void)
+{
+}
+#endif
+
+/**
+ * Private scheduler latency API
+ */
+
+#ifdef UTHREAD_STATS
+/*
+ * latency_ready_delay - Account time a thread waited in the ready queue
+ * @ns: Delay from becoming ready to running, in nanoseconds
+ *
+ * Must be called with preemption disabled.
+ */
+void latency_ready_delay(uint64_t ns);
+
+/*
+ * latency_slice - Account time slice of a thread
+ * @ns: Time the thread ran before switching out, in nanoseconds
+ *
+ * Ignored unless preemption is started. Must be called with preemption
+ * disabled.
+ */
+void latency_slice(uint64_t ns);
+#endif
+
+/*
+ * latency_stop - Stop periodic report of scheduler latency
+ *
+ * Must be called with preemption disabled.
+ */
+void latency_stop(void);
+
+
+/**
+ * Private stack watching API
+ */
+
+/* Whether uthread_ctx_alloc_stack() fills stacks with the canary pattern */
+extern bool stack_watched;
+
+/*
+ * stack_record - Account stack high-water mark of exited thread
+ * @func: Function the thread was created with
+ * @used: High-water mark, in bytes
+ *
+ * Must be called with preemption disabled.
+ */
+void stack_record(uthread_func_t func, size_t used);
+
+/**
+ * Private profiling API
+ */
+
+/*
+ * profile_sample - Record sample of running thread
+ * @ucontext: Context interrupted by the timer signal
+ *
+ * Called from the timer signal handler.
+ */
+void profile_sample(void *ucontext);
+
+/*
+ * uthread_stack_bounds - Get stack segment of running thread
+ * @lo: Address where to store the lowest address of the stack
+ * @hi: Address where to store the address right above the stack
+ *
+ * Return: -1 if the running thread has no stack of its own (idle thread), 0
+ * otherwise
+ */
+int uthread_stack_bounds(uintptr_t *lo, uintptr_t *hi);
+
+/**
+ * Private tracing API
+ */
+
+/* Scheduler events */
+#define TRACE_CREATE	0	/* Argument is identifier of created thread */
+#define TRACE_RUN	1
+#define TRACE_YIELD	2
+#define TRACE_PREEMPT	3
+#define TRACE_BLOCK	4
+#define TRACE_UNBLOCK	5	/* Argument is identifier of unblocking thread */
+#define TRACE_EXIT	6
+#define TRACE_SEM_DOWN	7	/* Argument is address of semaphore */
+#define TRACE_SEM_UP	8	/* Argument is address of semaphore */
+
+/* Whether tracing is enabled */
+extern bool trace_on;
+
+/*
+ * trace_add - Record event into the trace ring buffer
+ * @type: One of the TRACE_* event types
+ * @tid: Thread the event is about
+ * @arg: Argument of the event
+ *
+ * Must be called with preemption disabled, and only while tracing is enabled.
+ */
+void trace_add(int type, uthread_t tid, uint64_t arg);
+
+/*
+ * trace_record - Record event if tracing is enabled
+ *
+ * The arguments are only evaluated if tracing is enabled.
+ */
+#define trace_record(type, tid, arg)			\
+do {							\
+	if (trace_on)					\
+		trace_add(type, tid, arg);		\
+} while (0)
+
+/**
+ * Private record and replay API
+ */
+
+/* Replay modes */
+#define REPLAY_MODE_OFF		0
+#define REPLAY_MODE_RECORD	1
+#define REPLAY_MODE_PLAY	2
+
+/* Scheduler decisions */
+#define REPLAY_YIELD	0	/* Running thread yielded or handed over */
+#define REPLAY_PREEMPT	1
+#define REPLAY_BLOCK	2
+#define REPLAY_EXIT	3
+#define REPLAY_TIMERS	4	/* Idle thread fired timers */
+
+/* Whether scheduler decisions are recorded or replayed */
+extern int replay_mode;
+
+/*
+ * replay_log_switch - Record or check context switch
+ * @type: REPLAY_YIELD, REPLAY_PREEMPT, REPLAY_BLOCK or REPLAY_EXIT
+ * @next: Thread switched to
+ *
+ * Preemptions are identified by the number of ticks into the slice. A switch
+ * differing from the log ends the replay. Must be called with preemption
+ * disabled, before the next slice starts.
+ */
+void replay_log_switch(int type, uthread_t next);
+
+/*
+ * replay_switch - Record or check context switch if replay is enabled
+ */
+#define replay_switch(type, next)			\
+do {							\
+	if (replay_mode != REPLAY_MODE_OFF)		\
+		replay_log_switch(type, next);		\
+} while (0)
+
+/*
+ * replay_preempt_ticks - Get recorded preemption point of running thread
+ *
+ * Return: Number of ticks counted in the slice when the running thread must be
+ * preempted, -1 if the next recorded decision isn't a preemption
+ */
+long replay_preempt_ticks(void);
+
+/*
+ * replay_timers - Get number of timers to fire
+ *
+ * Return: Number of expired timers that the idle thread fired at this point
+ * of the recorded run, regardless of their deadline. -1 if not replaying.
+ */
+long replay_timers(void);
+
+/*
+ * replay_timers_fired - Record timers fired by the idle thread
+ * @n: Number of timers fired
+ */
+void replay_timers_fired(unsigned long n);
+
+/*
+ * replay_wake - Check whether idle thread can skip sleeping
+ *
+ * While replaying, the idle thread has nothing to wait for once the next
+ * recorded decision is to fire timers. Anything else ends the replay, as it
+ * was something else which woke the recorded run up.
+ *
+ * Return: true if the idle thread must fire timers rather than sleep
+ */
+bool replay_wake(void);
+
 #endif /* _UTHREAD_PRIVATE_H */
@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "private.h"
+#include "profile.h"
+
+/* Maximum number of frames of a sample, sampled function included */
+#define PROFILE_DEPTH 8
+
+struct profile_sample {
+	uthread_t tid;
+	size_t depth;
+	uintptr_t pc[PROFILE_DEPTH];	/* Innermost frame first */
+};
+
+/*
+ * Sample buffer, only written by the timer handler and only read with
+ * preemption disabled, so that it needs no locking
+ */
+static struct profile_sample *profile_buf;
+static size_t profile_capacity, profile_len;
+
+/* Walk frame pointers from @fp, within the stack of the running thread */
+static void profile_backtrace(struct profile_sample *s, uintptr_t fp)
+{
+	uintptr_t lo, hi, *frame;
+
+	if (uthread_stack_bounds(&lo, &hi))
+		return;
+
+	while (s->depth < PROFILE_DEPTH && fp >= lo &&
+	       fp <= hi - 2 * sizeof(uintptr_t) &&
+	       fp % sizeof(uintptr_t) == 0) {
+		frame = (uintptr_t *)fp;
+		s->pc[s->depth++] = frame[1];
+		/* Stacks grow down: callers' frames are above */
+		if (frame[0] <= fp)
+			break;
+		fp = frame[0];
+	}
+}
+
+void profile_sample(void *ucontext)
+{
+	struct profile_sample *s;
+
+	/* Buffer full: drop sample */
+	if (profile_len == profile_capacity)
+		return;
+
+	/* Timer fired before the idle thread was installed or after it left */
+	if (uthread_current() == NULL)
+		return;
+
+	s = &profile_buf[profile_len++];
+	s->tid = uthread_self();
+	s->depth = 0;
+#if defined(__x86_64__)
+	ucontext_t *uc = ucontext;
+
+	s->pc[s->depth++] = uc->uc_mcontext.gregs[REG_RIP];
+	profile_backtrace(s, uc->uc_mcontext.gregs[REG_RBP]);
+#else
+	(void)ucontext;
+	(void)profile_backtrace;
+#endif
+}
+
+int uthread_profile_start(unsigned long period_us, size_t capacity)
+{
+	if (period_us == 0 || capacity == 0)
+		return -1;
+
+	preempt_disable();
+	if (profile_buf == NULL) {
+		profile_buf = malloc(capacity * sizeof(*profile_buf));
+		if (profile_buf == NULL) {
+			preempt_enable();
+			return -1;
+		}
+		profile_capacity = capacity;
+		profile_len = 0;
+	}
+	if (preempt_set_profile(period_us)) {
+		preempt_set_profile(0);
+		preempt_enable();
+		return -1;
+	}
+	preempt_enable();
+
+	return 0;
+}
+
+void uthread_profile_stop(void)
+{
+	preempt_disable();
+	preempt_set_profile(0);
+	preempt_enable();
+}
+
+void uthread_profile_reset(void)
+{
+	preempt_disable();
+	preempt_set_profile(0);
+	free(profile_buf);
+	profile_buf = NULL;
+	profile_capacity = 0;
+	profile_len = 0;
+	preempt_enable();
+}
+
+/* Maximum length of a folded stack */
+#define PROFILE_LINE 512
+
+/*
+ * profile_print_frame - Print name of function containing @pc
+ * @ret: Whether @pc is a return address, which may point right past the end
+ *	of the calling function
+ */
+static int profile_print_frame(char *buf, size_t size, uintptr_t pc, bool ret)
+{
+	Dl_info info;
+	const char *file;
+
+	if (dladdr((void *)(ret ? pc - 1 : pc), &info) == 0 ||
+	    info.dli_fname == NULL)
+		return snprintf(buf, size, ";%#lx", (unsigned long)pc);
+	if (info.dli_sname)
+		return snprintf(buf, size, ";%s", info.dli_sname);
+
+	/* Unknown function: module and offset, for addr2line */
+	file = strrchr(info.dli_fname, '/');
+	return snprintf(buf, size, ";%s+%#lx", file ? file + 1 : info.dli_fname,
+			(unsigned long)(pc - (uintptr_t)info.dli_fbase));
+}
+
+/* Format folded stack of @s, from the thread down to the sampled function */
+static void profile_print_stack(char *buf, struct profile_sample *s)
+{
+	size_t i, len;
+
+	if (s->tid == 0)
+		len = snprintf(buf, PROFILE_LINE, "idle");
+	else
+		len = snprintf(buf, PROFILE_LINE, "uthread-%lu", s->tid);
+	for (i = s->depth; i > 0 && len < PROFILE_LINE; i--)
+		len += profile_print_frame(buf + len, PROFILE_LINE - len,
+					   s->pc[i - 1], i > 1);
+}
+
+static int profile_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int uthread_profile_dump(FILE *out)
+{
+	unsigned long count = 0;
+	char *lines, **sorted;
+	size_t i, len;
+
+	if (out == NULL || profile_buf == NULL)
+		return -1;
+
+	/* Samples of distinct addresses within the same functions are merged
+	 * once symbolized */
+	preempt_disable();
+	len = profile_len;
+	lines = malloc(len * PROFILE_LINE + 1);
+	sorted = malloc(len * sizeof(*sorted) + 1);
+	if (lines == NULL || sorted == NULL) {
+		free(lines);
+		free(sorted);
+		preempt_enable();
+		return -1;
+	}
+	for (i = 0; i < len; i++) {
+		sorted[i] = lines + i * PROFILE_LINE;
+		profile_print_stack(sorted[i], &profile_buf[i]);
+	}
+	qsort(sorted, len, sizeof(*sorted), profile_cmp);
+
+	for (i = 0; i < len; i++) {
+		count++;
+		if (i + 1 < len && strcmp(sorted[i], sorted[i + 1]) == 0)
+			continue;
+		fprintf(out, "%s %lu\n", sorted[i], count);
+		count = 0;
+	}
+	free(lines);
+	free(sorted);
+	preempt_enable();
+
+	return len;
+}
@@ -0,0 +1,63 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Sampling profiler
+ *
+ * While profiling, the preemption timer also fires every sampling period, and
+ * its handler records the running thread, the interrupted instruction and a
+ * shallow backtrace, by walking the frame pointers within the stack of the
+ * thread. No other signal is used: samples are only taken while the library
+ * runs with preemption enabled, and over the clock chosen for preemption.
+ *
+ * Backtraces are only reliable through code compiled with
+ * -fno-omit-frame-pointer, and function names of the executable are only
+ * found if it is linked with -rdynamic. Backtraces are only taken on x86-64.
+ */
+
+/*
+ * uthread_profile_start - Start sampling
+ * @period_us: Sampling period, in microseconds
+ * @capacity: Maximum number of samples to keep. Only used to allocate the
+ *	sample buffer the first time, or after uthread_profile_reset()
+ *
+ * Can be called before uthread_run() or from any thread. Once the buffer is
+ * full, further samples are dropped.
+ *
+ * Return: -1 if @period_us or @capacity are 0, or in case of failure when
+ * allocating the buffer or arming the timer. 0 otherwise.
+ */
+int uthread_profile_start(unsigned long period_us, size_t capacity);
+
+/*
+ * uthread_profile_stop - Stop sampling
+ *
+ * Samples taken so far are kept.
+ */
+void uthread_profile_stop(void);
+
+/*
+ * uthread_profile_reset - Discard samples
+ *
+ * Sampling is stopped and the sample buffer is deallocated.
+ */
+void uthread_profile_reset(void);
+
+/*
+ * uthread_profile_dump - Write samples in folded stack format
+ * @out: Stream where to write the samples
+ *
+ * Write one line per distinct stack, with its frames from the thread
+ * ("uthread-<tid>", or "idle") down to the sampled function separated by
+ * semicolons, followed by the number of samples of that stack. This is the
+ * input format of flame graph tools.
+ *
+ * Return: -1 if @out is NULL or if no buffer was allocated. Number of samples
+ * otherwise.
+ */
+int uthread_profile_dump(FILE *out);
+
+#endif /* _PROFILE_H */
@@ -1,9 +1,22 @@
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include "queue.h"
 
+/* Default capacity of ring buffer queues */
+#define QUEUE_RING_MIN 8
+
+/* Initial number of slots of queue indexes */
+#define QUEUE_INDEX_MIN 16
+
+/* Size and alignment of node pool slabs */
+#define QUEUE_SLAB_SIZE 4096
+
+/* Default number of free nodes retained by the node pool */
+#define QUEUE_POOL_CAP 1024
+
 typedef struct node* node_t;
 struct node {
         void* data;
@@ -14,18 +27,388 @@ struct node {
 struct queue {
         /* Phase 1 */
         int count;
-        node_t head;
-        node_t tail;
+        bool ring; // backend: linked list or ring buffer
+        union {
+                /* Linked list */
+                struct {
+                        node_t head;
+                        node_t tail;
+                        struct queue_index *index; // NULL if not indexed
+                };
+                /* Ring buffer of data pointers, indexed by absolute positions
+                 * so that positions stay valid while the buffer grows */
+                struct {
+                        void **slots;
+                        unsigned int mask;      // capacity - 1
+                        unsigned int first;     // position of oldest slot
+                        unsigned int used;      // slots in use, holes included
+                        unsigned int holes;     // items deleted while iterating
+                        unsigned int iterating;
+                };
+        };
+};
+
+/*
+ * Node pool
+ *
+ * Linked list nodes are carved out of slabs, which are aligned on their size so
+ * that the slab of a node is found by masking its address. Each slab keeps its
+ * own list of free nodes, and slabs with free nodes are linked together. Nodes
+ * are thus recycled without calling the allocator, which is only called to
+ * refill the pool with a new slab. A slab whose nodes are all free is released
+ * once the pool retains more free nodes than its cap.
+ *
+ * Each OS thread has its own pool, shared by the queues it uses, so that
+ * queues used by different OS threads share no state. A node goes back to the
+ * pool of the OS thread which allocated it: a queue may only move to another
+ * OS thread once it is empty.
+ */
+struct queue_slab {
+        struct queue_slab *prev, *next; // slabs with free nodes
+        node_t free;
+        unsigned int used;
+        struct node nodes[];
+};
+
+#define QUEUE_SLAB_NODES ((QUEUE_SLAB_SIZE - sizeof(struct queue_slab)) / sizeof(struct node))
+
+static _Thread_local struct {
+        struct queue_slab *partial;
+        size_t free_nodes;
+        size_t cap;
+        struct queue_pool_stats stats;
+} pool = { .cap = QUEUE_POOL_CAP };
+
+static void slab_link(struct queue_slab *slab)
+{
+        slab->prev = NULL;
+        slab->next = pool.partial;
+        if (pool.partial) {
+                pool.partial->prev = slab;
+        }
+        pool.partial = slab;
+}
+
+static void slab_unlink(struct queue_slab *slab)
+{
+        if (slab->prev) {
+                slab->prev->next = slab->next;
+        } else {
+                pool.partial = slab->next;
+        }
+        if (slab->next) {
+                slab->next->prev = slab->prev;
+        }
+}
+
+static struct queue_slab *slab_create(void)
+{
+        struct queue_slab *slab = aligned_alloc(QUEUE_SLAB_SIZE, QUEUE_SLAB_SIZE);
+        unsigned int i;
+
+        if (slab == NULL) {
+                return NULL;
+        }
+        slab->free = NULL;
+        slab->used = 0;
+        for (i = QUEUE_SLAB_NODES; i-- > 0;) {
+                slab->nodes[i].next = slab->free;
+                slab->free = &slab->nodes[i];
+        }
+        slab_link(slab);
+        pool.free_nodes += QUEUE_SLAB_NODES;
+        pool.stats.slabs++;
+
+        return slab;
+}
+
+static node_t node_alloc(void)
+{
+        struct queue_slab *slab = pool.partial;
+        node_t node;
+
+        if (slab == NULL) {
+                slab = slab_create();
+                if (slab == NULL) {
+                        return NULL;
+                }
+                pool.stats.misses++;
+        } else {
+                pool.stats.hits++;
+        }
+
+        node = slab->free;
+        slab->free = node->next;
+        slab->used++;
+        pool.free_nodes--;
+        if (slab->free == NULL) {
+                slab_unlink(slab);
+        }
+
+        return node;
+}
+
+static void node_free(node_t node)
+{
+        struct queue_slab *slab = (struct queue_slab *)((uintptr_t)node & ~(uintptr_t)(QUEUE_SLAB_SIZE - 1));
+
+        if (slab->free == NULL) {
+                slab_link(slab);
+        }
+        node->next = slab->free;
+        slab->free = node;
+        slab->used--;
+        pool.free_nodes++;
+
+        /* Give empty slabs back beyond the cap */
+        if (slab->used == 0 && pool.free_nodes - QUEUE_SLAB_NODES >= pool.cap) {
+                slab_unlink(slab);
+                pool.free_nodes -= QUEUE_SLAB_NODES;
+                pool.stats.slabs--;
+                free(slab);
+        }
+}
+
+void queue_pool_set_cap(size_t cap)
+{
+        pool.cap = cap;
+}
+
+void queue_pool_get_stats(struct queue_pool_stats *stats)
+{
+        if (stats == NULL) {
+                return;
+        }
+        *stats = pool.stats;
+        stats->free_nodes = pool.free_nodes;
+}
+
+/*
+ * Index of linked list nodes by data address
+ *
+ * Open addressing hash table with linear probing. Deleted entries are not
+ * marked, instead the following entries of the probe sequence are shifted back
+ * into the free slot. The table is kept at most half full.
+ */
+struct queue_index {
+        unsigned int mask;      // number of slots - 1
+        unsigned int shift;     // 64 - log2(number of slots)
+        node_t slots[];
 };
 
+static unsigned int index_hash(struct queue_index *index, void *data)
+{
+        /* Fibonacci hashing: the top bits of the product depend on every bit
+         * of the address, so that keys of any alignment spread evenly */
+        return ((uint64_t)(uintptr_t)data * 0x9e3779b97f4a7c15ULL) >> index->shift;
+}
+
+static struct queue_index *index_create(unsigned int size)
+{
+        struct queue_index *index = calloc(1, sizeof(struct queue_index) + size * sizeof(node_t));
+
+        if (index == NULL) {
+                return NULL;
+        }
+        index->mask = size - 1;
+        index->shift = 64 - __builtin_ctz(size);
+
+        return index;
+}
+
+/* Return slot of @data in @index, or of the free slot where it would go */
+static unsigned int index_find(struct queue_index *index, void *data)
+{
+        unsigned int i = index_hash(index, data);
+
+        while (index->slots[i] != NULL && index->slots[i]->data != data) {
+                i = (i + 1) & index->mask;
+        }
+
+        return i;
+}
+
+static void index_insert(struct queue_index *index, node_t node)
+{
+        index->slots[index_find(index, node->data)] = node;
+}
+
+static void index_remove(struct queue_index *index, unsigned int i)
+{
+        unsigned int j = i, home;
+
+        /* Shift back the entries that can't be found anymore once slot @i is
+         * free, i.e. whose home slot isn't cyclically within (i, j] */
+        while (1) {
+                j = (j + 1) & index->mask;
+                if (index->slots[j] == NULL) {
+                        break;
+                }
+                home = index_hash(index, index->slots[j]->data);
+                if (((j - home) & index->mask) >= ((j - i) & index->mask)) {
+                        index->slots[i] = index->slots[j];
+                        i = j;
+                }
+        }
+        index->slots[i] = NULL;
+}
+
+static int index_grow(queue_t queue)
+{
+        struct queue_index *index = index_create((queue->index->mask + 1) * 2);
+        node_t node;
+
+        if (index == NULL) {
+                return -1;
+        }
+        for (node = queue->head; node != NULL; node = node->next) {
+                index_insert(index, node);
+        }
+        free(queue->index);
+        queue->index = index;
+
+        return 0;
+}
+
+/*
+ * Ring buffer backend
+ *
+ * Items deleted while the queue is being iterated leave a hole (a NULL slot)
+ * behind, so that the positions of the following items don't change under the
+ * iteration. Holes are skipped by dequeue and compacted once the iteration is
+ * over.
+ */
+
+static void **ring_slot(queue_t queue, unsigned int pos)
+{
+        return &queue->slots[pos & queue->mask];
+}
+
+static int ring_init(queue_t queue, unsigned int capacity)
+{
+        unsigned int size = QUEUE_RING_MIN;
+
+        while (size < capacity) {
+                size <<= 1;
+        }
+        queue->slots = malloc(size * sizeof(void *));
+        if (queue->slots == NULL) {
+                return -1;
+        }
+        queue->ring = true;
+        queue->mask = size - 1;
+        queue->first = 0;
+        queue->used = 0;
+        queue->holes = 0;
+        queue->iterating = 0;
+
+        return 0;
+}
+
+static int ring_grow(queue_t queue)
+{
+        unsigned int size = (queue->mask + 1) * 2, pos;
+        void **slots = malloc(size * sizeof(void *));
+
+        if (slots == NULL) {
+                return -1;
+        }
+        for (pos = queue->first; pos != queue->first + queue->used; pos++) {
+                slots[pos & (size - 1)] = *ring_slot(queue, pos);
+        }
+        free(queue->slots);
+        queue->slots = slots;
+        queue->mask = size - 1;
+
+        return 0;
+}
+
+static void ring_skip_holes(queue_t queue)
+{
+        while (queue->used > 0 && *ring_slot(queue, queue->first) == NULL) {
+                queue->first++;
+                queue->used--;
+                queue->holes--;
+        }
+}
+
+/* Remove the item at @pos by shifting the newer items down */
+static void ring_remove(queue_t queue, unsigned int pos)
+{
+        unsigned int last = queue->first + queue->used - 1;
+
+        for (; pos != last; pos++) {
+                *ring_slot(queue, pos) = *ring_slot(queue, pos + 1);
+        }
+        queue->used--;
+}
+
+static void ring_compact(queue_t queue)
+{
+        unsigned int pos, to = queue->first;
+
+        for (pos = queue->first; pos != queue->first + queue->used; pos++) {
+                if (*ring_slot(queue, pos) != NULL) {
+                        *ring_slot(queue, to++) = *ring_slot(queue, pos);
+                }
+        }
+        queue->used = to - queue->first;
+        queue->holes = 0;
+}
+
 queue_t queue_create(void)
 {
         /* Phase 1 */
+#ifdef QUEUE_RING
+        return queue_create_ex(QUEUE_RING_MIN);
+#else
         queue_t queue = (queue_t)malloc(sizeof(struct queue));
 
+        if (queue == NULL) {
+                return NULL;
+        }
         queue->count = 0;
+        queue->ring = false;
         queue->head = NULL;
         queue->tail = NULL;
+        queue->index = NULL;
+
+        return queue;
+#endif
+}
+
+queue_t queue_create_indexed(void)
+{
+        queue_t queue = (queue_t)malloc(sizeof(struct queue));
+
+        if (queue == NULL) {
+                return NULL;
+        }
+        queue->count = 0;
+        queue->ring = false;
+        queue->head = NULL;
+        queue->tail = NULL;
+        queue->index = index_create(QUEUE_INDEX_MIN);
+        if (queue->index == NULL) {
+                free(queue);
+                return NULL;
+        }
+
+        return queue;
+}
+
+queue_t queue_create_ex(int capacity_hint)
+{
+        queue_t queue = (queue_t)malloc(sizeof(struct queue));
+
+        if (queue == NULL) {
+                return NULL;
+        }
+        queue->count = 0;
+        if (ring_init(queue, capacity_hint > 0 ? capacity_hint : 0) == -1) {
+                free(queue);
+                return NULL;
+        }
 
         return queue;
 }
@@ -36,6 +419,11 @@ int queue_destroy(queue_t queue)
         if (queue == NULL || queue->count != 0) {
                 return -1;
         } else {
+                if (queue->ring) {
+                        free(queue->slots);
+                } else {
+                        free(queue->index);
+                }
                 free(queue);
                 queue = NULL; // prevent dangling pointer to queue
                 return 0;
@@ -45,9 +433,34 @@ int queue_destroy(queue_t queue)
 int queue_enqueue(queue_t queue, void *data)
 {
         /* Phase 1 */
-        node_t new_node = (node_t)malloc(sizeof(struct node));
+        if (queue == NULL || data == NULL) {
+                return -1;
+        }
+
+        if (queue->ring) {
+                if (queue->used == queue->mask + 1 && ring_grow(queue) == -1) {
+                        return -1;
+                }
+                *ring_slot(queue, queue->first + queue->used) = data;
+                queue->used++;
+                queue->count++;
+                return 0;
+        }
 
-        if (queue == NULL || data == NULL || new_node == NULL) {
+        /* Indexed queues hold each item at most once */
+        if (queue->index) {
+                if (queue->index->slots[index_find(queue->index, data)] != NULL) {
+                        return -1;
+                }
+                if ((unsigned int)queue->count * 2 >= queue->index->mask &&
+                    index_grow(queue) == -1) {
+                        return -1;
+                }
+        }
+
+        node_t new_node = node_alloc();
+
+        if (new_node == NULL) {
                 return -1;
         }
 
@@ -64,10 +477,45 @@ int queue_enqueue(queue_t queue, void *data)
                 queue->tail = new_node;
         }
         queue->count++;
+        if (queue->index) {
+                index_insert(queue->index, new_node);
+        }
 
         return 0;
 }
 
+int queue_enqueue_bulk(queue_t queue, void **items, int n)
+{
+        int i;
+
+        if (queue == NULL || items == NULL || n < 0) {
+                return -1;
+        }
+
+        if (queue->ring) {
+                /* Grow up front for the whole batch */
+                while (queue->used + n > queue->mask + 1) {
+                        if (ring_grow(queue) == -1) {
+                                break;
+                        }
+                }
+                for (i = 0; i < n && items[i] != NULL && queue->used <= queue->mask; i++) {
+                        *ring_slot(queue, queue->first + queue->used) = items[i];
+                        queue->used++;
+                }
+                queue->count += i;
+                return i;
+        }
+
+        for (i = 0; i < n; i++) {
+                if (queue_enqueue(queue, items[i]) == -1) {
+                        break;
+                }
+        }
+
+        return i;
+}
+
 int queue_dequeue(queue_t queue, void **data)
 {
         /* Phase 1 */
@@ -75,8 +523,20 @@ int queue_dequeue(queue_t queue, void **data)
                 return -1;
         }
 
+        if (queue->ring) {
+                ring_skip_holes(queue);
+                *data = *ring_slot(queue, queue->first);
+                queue->first++;
+                queue->used--;
+                queue->count--;
+                return 0;
+        }
+
         node_t node = queue->head;
         *data = queue->head->data; // Assign data of head node to data
+        if (queue->index) {
+                index_remove(queue->index, index_find(queue->index, node->data));
+        }
 
         if (queue->head == queue->tail) {
                 queue->head = NULL;
@@ -86,7 +546,39 @@ int queue_dequeue(queue_t queue, void **data)
                 queue->head->prev = NULL;
         }
         queue->count--;
-        free(node); // Free allocated memory
+        node_free(node); // Give node back to pool
+
+        return 0;
+}
+
+int queue_dequeue_bulk(queue_t queue, void **out, int max)
+{
+        int i;
+
+        if (queue == NULL || out == NULL || max < 0) {
+                return -1;
+        }
+
+        for (i = 0; i < max && queue->count > 0; i++) {
+                queue_dequeue(queue, &out[i]);
+        }
+
+        return i;
+}
+
+int queue_peek(queue_t queue, void **data)
+{
+        if (queue == NULL || data == NULL || queue->count == 0) {
+                return -1;
+        }
+
+        if (queue->ring) {
+                ring_skip_holes(queue);
+                *data = *ring_slot(queue, queue->first);
+                return 0;
+        }
+
+        *data = queue->head->data;
 
         return 0;
 }
@@ -98,14 +590,44 @@ int queue_delete(queue_t queue, void *data)
                 return -1;
         }
 
+        if (queue->ring) {
+                unsigned int pos;
+
+                for (pos = queue->first; pos != queue->first + queue->used; pos++) {
+                        if (*ring_slot(queue, pos) == data) {
+                                if (queue->iterating) {
+                                        *ring_slot(queue, pos) = NULL;
+                                        queue->holes++;
+                                } else {
+                                        ring_remove(queue, pos);
+                                }
+                                queue->count--;
+                                return 0;
+                        }
+                }
+                return -1;
+        }
+
         node_t node = queue->head;
+
+        /* Indexed queues find the node directly */
+        if (queue->index) {
+                unsigned int i = index_find(queue->index, data);
+
+                node = queue->index->slots[i];
+                if (node == NULL) {
+                        return -1;
+                }
+                index_remove(queue->index, i);
+        }
         while(node != NULL) {
                 if (node->data == data) {
-                        if (queue->count == 0) { // If there is only one item in queue
+                        if (queue->count == 1) { // If there is only one item in queue
                                 queue->head = NULL;
                                 queue->tail = NULL;
                         } else if (node == queue->head) { // If there is > 1 items in queue and deleting head item
                                 queue->head = node->next;
+                                queue->head->prev = NULL;
                         } else if (node == queue->tail){ // If there is > 1 item in queue and removing tail item
                                 queue->tail = queue->tail->prev;
                                 queue->tail->next = NULL;
@@ -113,7 +635,7 @@ int queue_delete(queue_t queue, void *data)
                                 node->prev->next = node->next;
                                 node->next->prev = node->prev;
                         }
-                        free(node);
+                        node_free(node);
                         node = NULL; // prevent dangling pointers
                         queue->count--;
                         return 0;
@@ -124,22 +646,171 @@ int queue_delete(queue_t queue, void *data)
         return -1;
 }
 
-int queue_iterate(queue_t queue, queue_func_t func)
+int queue_splice(queue_t dst, queue_t src)
 {
-        /* Phase 1 */
-        if (queue == NULL || func == NULL) {
+        void *data;
+
+        if (dst == NULL || src == NULL || dst == src) {
                 return -1;
         }
 
+        /* Relink the whole list at once, unless @dst needs to index it */
+        if (!dst->ring && !src->ring && dst->index == NULL) {
+                if (src->count == 0) {
+                        return 0;
+                }
+                if (dst->count == 0) {
+                        dst->head = src->head;
+                } else {
+                        dst->tail->next = src->head;
+                        src->head->prev = dst->tail;
+                }
+                dst->tail = src->tail;
+                dst->count += src->count;
+                src->head = NULL;
+                src->tail = NULL;
+                src->count = 0;
+                if (src->index) {
+                        memset(src->index->slots, 0, (src->index->mask + 1) * sizeof(node_t));
+                }
+                return 0;
+        }
+
+        while (queue_peek(src, &data) == 0) {
+                if (queue_enqueue(dst, data) == -1) {
+                        return -1;
+                }
+                queue_dequeue(src, &data);
+        }
+
+        return 0;
+}
+
+/* Call whichever of @func or @until is set on @data */
+static int iterate_call(queue_t queue, queue_func_t func, queue_until_func_t until, void *data)
+{
+        if (until != NULL) {
+                return until(queue, data);
+        }
+        func(queue, data);
+
+        return 0;
+}
+
+static int iterate(queue_t queue, queue_func_t func, queue_until_func_t until, void **data)
+{
+        int stop = 0;
+
+        if (queue->ring) {
+                unsigned int pos = queue->first;
+
+                queue->iterating++;
+                /* Items may be dequeued, deleted or enqueued by @func */
+                for (; stop == 0 && pos - queue->first < queue->used; pos++) {
+                        void *item = *ring_slot(queue, pos);
+
+                        if (item != NULL) {
+                                stop = iterate_call(queue, func, until, item);
+                                if (stop && data) {
+                                        *data = item;
+                                }
+                        }
+                        if ((int)(pos - queue->first) < 0) {
+                                pos = queue->first - 1;
+                        }
+                }
+                if (--queue->iterating == 0 && queue->holes) {
+                        ring_compact(queue);
+                }
+                return stop;
+        }
+
         node_t node = queue->head;
         while (node != NULL) {
                 node_t next = node->next; // keep track of next node in case deleted
-                func(queue, node->data);
+                void *item = node->data;
+
+                stop = iterate_call(queue, func, until, item);
+                if (stop) {
+                        if (data) {
+                                *data = item;
+                        }
+                        break;
+                }
                 node = next;
         }
+        return stop;
+}
+
+int queue_iterate(queue_t queue, queue_func_t func)
+{
+        /* Phase 1 */
+        if (queue == NULL || func == NULL) {
+                return -1;
+        }
+
+        return iterate(queue, func, NULL, NULL);
+}
+
+int queue_iterate_until(queue_t queue, queue_until_func_t func, void **data)
+{
+        if (queue == NULL || func == NULL) {
+                return -1;
+        }
+
+        return iterate(queue, NULL, func, data);
+}
+
+int queue_contains(queue_t queue, void *data)
+{
+        if (queue == NULL || data == NULL) {
+                return -1;
+        }
+
+        if (queue->ring) {
+                unsigned int pos;
+
+                for (pos = queue->first; pos != queue->first + queue->used; pos++) {
+                        if (*ring_slot(queue, pos) == data) {
+                                return 1;
+                        }
+                }
+                return 0;
+        }
+
+        if (queue->index) {
+                return queue->index->slots[index_find(queue->index, data)] != NULL;
+        }
+
+        node_t node;
+        for (node = queue->head; node != NULL; node = node->next) {
+                if (node->data == data) {
+                        return 1;
+                }
+        }
         return 0;
 }
 
+size_t queue_footprint(queue_t queue)
+{
+        size_t size;
+
+        if (queue == NULL) {
+                return 0;
+        }
+
+        size = sizeof(struct queue);
+        if (queue->ring) {
+                return size + (queue->mask + 1) * sizeof(void *);
+        }
+        size += queue->count * sizeof(struct node);
+        if (queue->index) {
+                size += sizeof(struct queue_index) + (queue->index->mask + 1) * sizeof(node_t);
+        }
+
+        return size;
+}
+
 int queue_length(queue_t queue)
 {
         /* Phase 1 */
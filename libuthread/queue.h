@@ -1,6 +1,8 @@
 #ifndef _QUEUE_H
 #define _QUEUE_H
 
+#include <stddef.h>
+
 /*
  * queue_t - Queue type
  *
@@ -8,7 +10,8 @@
  * other.  When dequeueing, the queue must returned the oldest enqueued item
  * first and so on.
  *
- * Apart from delete and iterate operations, all operations should be O(1).
+ * Apart from delete, iterate and bulk operations, all operations should be
+ * O(1).
  */
 typedef struct queue* queue_t;
 
@@ -22,6 +25,41 @@ typedef struct queue* queue_t;
  */
 queue_t queue_create(void);
 
+/*
+ * queue_create_ex - Allocate an empty ring buffer queue
+ * @capacity_hint: Expected maximum number of items in the queue
+ *
+ * Create a new queue backed by a ring buffer of item addresses rather than by a
+ * linked list. The buffer is sized for at least @capacity_hint items, and grows
+ * by doubling its size whenever it is full. Enqueueing and dequeueing items
+ * therefore don't allocate memory (except for growing the buffer), and
+ * iterating through the queue scans contiguous memory.
+ *
+ * Queues created with queue_create() use the same backend if the library was
+ * built with QUEUE=ring.
+ *
+ * Return: Pointer to new empty queue. NULL in case of failure when allocating
+ * the new queue.
+ */
+queue_t queue_create_ex(int capacity_hint);
+
+/*
+ * queue_create_indexed - Allocate an empty indexed queue
+ *
+ * Create a new linked list queue that also keeps a hash table from item
+ * addresses to list nodes. Deleting an item and looking for an item are then
+ * O(1) on average instead of O(n), at the cost of the hash table, which is kept
+ * at most half full and thus takes at least 2 pointers per item (see
+ * queue_footprint()). Plain queues don't pay for it.
+ *
+ * An indexed queue holds each item at most once: enqueueing an item which is
+ * already in the queue fails.
+ *
+ * Return: Pointer to new empty queue. NULL in case of failure when allocating
+ * the new queue.
+ */
+queue_t queue_create_indexed(void);
+
 /*
  * queue_destroy - Deallocate a queue
  * @queue: Queue to deallocate
@@ -40,8 +78,9 @@ int queue_destroy(queue_t queue);
  *
  * Enqueue the address contained in @data in the queue @queue.
  *
- * Return: -1 if @queue or @data are NULL, or in case of memory allocation error
- * when enqueing. 0 if @data was successfully enqueued in @queue.
+ * Return: -1 if @queue or @data are NULL, in case of memory allocation error
+ * when enqueing, or if @queue is indexed and already contains @data. 0 if @data
+ * was successfully enqueued in @queue.
  */
 int queue_enqueue(queue_t queue, void *data);
 
@@ -58,6 +97,47 @@ int queue_enqueue(queue_t queue, void *data);
  */
 int queue_dequeue(queue_t queue, void **data);
 
+/*
+ * queue_enqueue_bulk - Enqueue several data items
+ * @queue: Queue in which to enqueue items
+ * @items: Array of addresses of data items to enqueue
+ * @n: Number of items in @items
+ *
+ * Enqueue the addresses contained in @items in the queue @queue, in array
+ * order. Ring buffer queues grow at most once for the whole batch. Enqueueing
+ * stops at the first item that queue_enqueue() would fail to enqueue.
+ *
+ * Return: -1 if @queue or @items are NULL, or if @n is negative. Number of
+ * items successfully enqueued otherwise.
+ */
+int queue_enqueue_bulk(queue_t queue, void **items, int n);
+
+/*
+ * queue_dequeue_bulk - Dequeue several data items
+ * @queue: Queue in which to dequeue items
+ * @out: Array where items are received
+ * @max: Maximum number of items to dequeue
+ *
+ * Remove up to @max of the oldest items of queue @queue and assign them to
+ * @out, oldest first.
+ *
+ * Return: -1 if @queue or @out are NULL, or if @max is negative. Number of
+ * items assigned to @out otherwise, 0 if the queue is empty.
+ */
+int queue_dequeue_bulk(queue_t queue, void **out, int max);
+
+/*
+ * queue_peek - Get oldest data item
+ * @queue: Queue in which to look for item
+ * @data: Address of data pointer where item is received
+ *
+ * Assign the oldest item of queue @queue to @data, without removing it.
+ *
+ * Return: -1 if @queue or @data are NULL, or if the queue is empty. 0 if @data
+ * was set with the oldest item available in @queue.
+ */
+int queue_peek(queue_t queue, void **data);
+
 /*
  * queue_delete - Delete data item
  * @queue: Queue in which to delete item
@@ -71,6 +151,23 @@ int queue_dequeue(queue_t queue, void **data);
  */
 int queue_delete(queue_t queue, void *data);
 
+/*
+ * queue_splice - Move all data items of a queue to another queue
+ * @dst: Queue in which to move items
+ * @src: Queue from which to move items
+ *
+ * Append all the items of queue @src after the newest item of queue @dst,
+ * preserving their order, and leave @src empty. Between two linked list queues
+ * this relinks the nodes of @src in O(1), without allocating or freeing memory
+ * (plus clearing the index of @src if it is indexed). Otherwise, the items are
+ * moved one by one.
+ *
+ * Return: -1 if @dst or @src are NULL or are the same queue, or if an item
+ * could not be enqueued in @dst, in which case the items not moved yet are
+ * left in @src. 0 if all items were moved.
+ */
+int queue_splice(queue_t dst, queue_t src);
+
 /*
  * queue_func_t - Queue callback function type
  * @queue: Queue to which item belongs
@@ -97,6 +194,92 @@ typedef void (*queue_func_t)(queue_t queue, void *data);
  */
 int queue_iterate(queue_t queue, queue_func_t func);
 
+/*
+ * queue_until_func_t - Queue callback function type with stop code
+ * @queue: Queue to which item belongs
+ * @data: Data item
+ *
+ * Function to be run on each item using queue_iterate_until(). The current
+ * item is received as @data.
+ *
+ * Return: 0 to continue the iteration, any other value to stop it
+ */
+typedef int (*queue_until_func_t)(queue_t queue, void *data);
+
+/*
+ * queue_iterate_until - Iterate through a queue until told to stop
+ * @queue: Queue to iterate through
+ * @func: Function to call on each queue item
+ * @data: Address of data pointer where item that stopped the iteration is
+ *	received, can be NULL
+ *
+ * Same as queue_iterate(), except that the iteration stops as soon as @func
+ * returns a non-zero stop code. If it does, the item on which it did is
+ * assigned to @data.
+ *
+ * Return: -1 if @queue or @func are NULL. 0 if @func returned 0 on every item,
+ * the stop code returned by @func otherwise.
+ */
+int queue_iterate_until(queue_t queue, queue_until_func_t func, void **data);
+
+/*
+ * queue_contains - Look for data item
+ * @queue: Queue in which to look for item
+ * @data: Data to look for
+ *
+ * Return: -1 if @queue or @data are NULL. 1 if @data is in @queue, 0 otherwise.
+ */
+int queue_contains(queue_t queue, void *data);
+
+/*
+ * queue_footprint - Queue memory footprint
+ * @queue: Queue to get the memory footprint of
+ *
+ * Return the number of bytes of memory used by queue @queue, including its
+ * nodes, its ring buffer or its index, but not the data items themselves.
+ *
+ * Return: 0 if @queue is NULL. Memory footprint of @queue otherwise.
+ */
+size_t queue_footprint(queue_t queue);
+
+/*
+ * struct queue_pool_stats - Node pool statistics
+ * @hits: Number of nodes recycled from the pool
+ * @misses: Number of nodes for which the pool had to be refilled
+ * @slabs: Number of slabs currently allocated
+ * @free_nodes: Number of free nodes currently retained
+ */
+struct queue_pool_stats {
+        unsigned long hits;
+        unsigned long misses;
+        size_t slabs;
+        size_t free_nodes;
+};
+
+/*
+ * queue_pool_set_cap - Set node pool cap
+ * @cap: Number of free nodes the pool may retain
+ *
+ * The nodes of linked list queues come from a pool shared by all the queues of
+ * the calling OS thread, which allocates them by slabs and recycles them when
+ * they are dequeued or deleted, so that enqueueing and dequeueing in steady
+ * state don't call the allocator. Slabs whose nodes are all free are released
+ * when the pool retains more than @cap free nodes.
+ *
+ * Each OS thread has its own pool, so that different OS threads can use their
+ * own queues concurrently. A queue must still be used from one OS thread at a
+ * time, and may only be handed over to another OS thread while it is empty,
+ * since its nodes go back to the pool they came from. This function and
+ * queue_pool_get_stats() apply to the pool of the calling OS thread.
+ */
+void queue_pool_set_cap(size_t cap);
+
+/*
+ * queue_pool_get_stats - Get node pool statistics of the calling OS thread
+ * @stats: Address where statistics are stored
+ */
+void queue_pool_get_stats(struct queue_pool_stats *stats);
+
 /*
  * queue_length - Queue length
  * @queue: Queue to get the length of
@@ -0,0 +1,323 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+#include "replay.h"
+
+/* Header of logs: magic and format version */
+#define REPLAY_MAGIC "UTRL"
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER 5
+
+/* Decision types are stored in the low bits of their first integer */
+#define REPLAY_TYPE_BITS 3
+
+int replay_mode;
+
+/*
+ * Log of decisions, only touched with preemption disabled while the library
+ * runs
+ */
+static unsigned char *replay_buf;
+static size_t replay_len, replay_capacity;
+static size_t replay_pos;		/* Offset of next decision to replay */
+static unsigned long replay_count;	/* Decisions recorded or replayed */
+static bool replay_loaded;		/* Whether the log is to be replayed */
+static bool replay_full, replay_diverged;
+static unsigned long replay_expected_timers;
+
+struct replay_event {
+	int type;
+	unsigned long arg;	/* Ticks of preemption, or number of timers */
+	uthread_t tid;		/* Thread switched to */
+	size_t next;		/* Offset of next decision */
+};
+
+static void replay_put_varint(uint64_t value)
+{
+	do {
+		if (replay_len == replay_capacity) {
+			replay_full = true;
+			return;
+		}
+		replay_buf[replay_len++] = (value & 0x7f) |
+			(value >= 0x80 ? 0x80 : 0);
+		value >>= 7;
+	} while (value);
+}
+
+/* Decode integer at @*pos. Return: -1 at end of log, 0 otherwise */
+static int replay_get_varint(size_t *pos, uint64_t *value)
+{
+	int shift = 0;
+
+	*value = 0;
+	while (*pos < replay_len && shift < 64) {
+		unsigned char byte = replay_buf[(*pos)++];
+
+		*value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return 0;
+		shift += 7;
+	}
+
+	return -1;
+}
+
+static void replay_put(int type, unsigned long arg, uthread_t tid)
+{
+	size_t len = replay_len;
+
+	replay_put_varint(((uint64_t)arg << REPLAY_TYPE_BITS) | type);
+	if (type != REPLAY_TIMERS)
+		replay_put_varint(tid);
+
+	/* Log full: drop partial decision and stop recording */
+	if (replay_full) {
+		replay_len = len;
+		replay_mode = REPLAY_MODE_OFF;
+		return;
+	}
+	replay_count++;
+}
+
+/* Decode next decision. Return: false at end of log */
+static bool replay_peek(struct replay_event *ev)
+{
+	uint64_t value, tid = 0;
+
+	ev->next = replay_pos;
+	if (replay_get_varint(&ev->next, &value))
+		return false;
+	ev->type = value & ((1 << REPLAY_TYPE_BITS) - 1);
+	ev->arg = value >> REPLAY_TYPE_BITS;
+	if (ev->type != REPLAY_TIMERS && replay_get_varint(&ev->next, &tid))
+		return false;
+	ev->tid = tid;
+
+	return true;
+}
+
+static void replay_next(const struct replay_event *ev)
+{
+	replay_pos = ev->next;
+	replay_count++;
+}
+
+/* Stop replaying, either at the end of the log or on a difference */
+static void replay_end(bool diverged)
+{
+	replay_mode = REPLAY_MODE_OFF;
+	replay_diverged = diverged;
+}
+
+void replay_log_switch(int type, uthread_t next)
+{
+	struct replay_event ev;
+	unsigned long ticks = type == REPLAY_PREEMPT ? preempt_get_ticks() : 0;
+
+	if (replay_mode == REPLAY_MODE_RECORD) {
+		replay_put(type, ticks, next);
+		return;
+	}
+
+	if (!replay_peek(&ev)) {
+		replay_end(false);
+		return;
+	}
+	if (ev.type != type || ev.arg != ticks || ev.tid != next) {
+		replay_end(true);
+		return;
+	}
+	replay_next(&ev);
+}
+
+long replay_preempt_ticks(void)
+{
+	struct replay_event ev;
+
+	if (replay_mode != REPLAY_MODE_PLAY || !replay_peek(&ev) ||
+	    ev.type != REPLAY_PREEMPT)
+		return -1;
+
+	return ev.arg;
+}
+
+long replay_timers(void)
+{
+	struct replay_event ev;
+
+	if (replay_mode != REPLAY_MODE_PLAY)
+		return -1;
+	if (!replay_peek(&ev)) {
+		replay_end(false);
+		return -1;
+	}
+
+	replay_expected_timers = 0;
+	if (ev.type == REPLAY_TIMERS) {
+		replay_expected_timers = ev.arg;
+		replay_next(&ev);
+	}
+
+	return replay_expected_timers;
+}
+
+void replay_timers_fired(unsigned long n)
+{
+	if (replay_mode == REPLAY_MODE_RECORD && n)
+		replay_put(REPLAY_TIMERS, n, 0);
+	else if (replay_mode == REPLAY_MODE_PLAY && n != replay_expected_timers)
+		replay_end(true);
+}
+
+bool replay_wake(void)
+{
+	struct replay_event ev;
+
+	if (replay_mode != REPLAY_MODE_PLAY)
+		return false;
+	if (!replay_peek(&ev)) {
+		replay_end(false);
+		return false;
+	}
+	if (ev.type != REPLAY_TIMERS) {
+		replay_end(true);
+		return false;
+	}
+
+	return true;
+}
+
+/* Discard log */
+static void replay_reset(void)
+{
+	free(replay_buf);
+	replay_buf = NULL;
+	replay_len = replay_capacity = replay_pos = 0;
+	replay_count = 0;
+	replay_loaded = replay_full = replay_diverged = false;
+}
+
+int uthread_record_start(size_t capacity)
+{
+	if (capacity == 0 || replay_mode == REPLAY_MODE_PLAY)
+		return -1;
+
+	preempt_disable();
+	replay_mode = REPLAY_MODE_OFF;
+	replay_reset();
+	replay_buf = malloc(capacity);
+	if (replay_buf == NULL) {
+		preempt_enable();
+		return -1;
+	}
+	replay_capacity = capacity;
+	replay_mode = REPLAY_MODE_RECORD;
+	preempt_enable();
+
+	return 0;
+}
+
+void uthread_record_stop(void)
+{
+	preempt_disable();
+	if (replay_mode == REPLAY_MODE_RECORD)
+		replay_mode = REPLAY_MODE_OFF;
+	preempt_enable();
+}
+
+long uthread_record_save(FILE *out)
+{
+	unsigned char header[REPLAY_HEADER] = REPLAY_MAGIC;
+	long count;
+
+	if (out == NULL)
+		return -1;
+
+	preempt_disable();
+	if (replay_buf == NULL || replay_loaded || replay_full) {
+		preempt_enable();
+		return -1;
+	}
+	header[REPLAY_HEADER - 1] = REPLAY_VERSION;
+	if (fwrite(header, 1, REPLAY_HEADER, out) != REPLAY_HEADER ||
+	    fwrite(replay_buf, 1, replay_len, out) != replay_len) {
+		preempt_enable();
+		return -1;
+	}
+	count = replay_count;
+	preempt_enable();
+
+	return count;
+}
+
+int uthread_replay_start(FILE *in)
+{
+	unsigned char header[REPLAY_HEADER];
+	unsigned char *buf = NULL;
+	size_t len = 0, capacity = 0, n;
+
+	if (in == NULL || replay_mode == REPLAY_MODE_RECORD)
+		return -1;
+
+	if (fread(header, 1, REPLAY_HEADER, in) != REPLAY_HEADER ||
+	    memcmp(header, REPLAY_MAGIC, REPLAY_HEADER - 1) ||
+	    header[REPLAY_HEADER - 1] != REPLAY_VERSION)
+		return -1;
+
+	/* Read whole log */
+	preempt_disable();
+	do {
+		if (len == capacity) {
+			void *grown;
+
+			capacity = capacity ? 2 * capacity : 4096;
+			grown = realloc(buf, capacity);
+			if (grown == NULL) {
+				free(buf);
+				preempt_enable();
+				return -1;
+			}
+			buf = grown;
+		}
+		n = fread(buf + len, 1, capacity - len, in);
+		len += n;
+	} while (n > 0);
+
+	replay_mode = REPLAY_MODE_OFF;
+	replay_reset();
+	replay_buf = buf;
+	replay_len = replay_capacity = len;
+	replay_loaded = true;
+	replay_mode = REPLAY_MODE_PLAY;
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_replay_stop(unsigned long *replayed)
+{
+	bool complete;
+
+	if (replayed)
+		*replayed = 0;
+
+	preempt_disable();
+	if (!replay_loaded) {
+		preempt_enable();
+		return -1;
+	}
+	complete = !replay_diverged && replay_pos == replay_len;
+	if (replayed)
+		*replayed = replay_count;
+	replay_mode = REPLAY_MODE_OFF;
+	replay_reset();
+	preempt_enable();
+
+	return complete ? 0 : -1;
+}
@@ -0,0 +1,79 @@
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+#include <stdio.h>
+
+/*
+ * Record and replay of scheduler decisions
+ *
+ * While recording, every context switch is logged with its cause (yield,
+ * preemption, block or exit) and the thread switched to, along with the number
+ * of expired timers the idle thread fires on each pass. A preemption is
+ * identified by the number of ticks into the slice of the preempted thread,
+ * ticks being counted on each entry into the library (see
+ * UTHREAD_CLOCK_TICKS), so that a run preempted by timer signals can be
+ * replayed as well as a deterministic one.
+ *
+ * While replaying, threads are preempted at the recorded ticks only, and
+ * timers fire at the recorded points regardless of their deadline. Each switch
+ * is checked against the log: the replay ends at the first difference, e.g.
+ * because the program changed or because the recorded run was woken up by
+ * another OS thread (see uthread_post_external()), which is not replayed.
+ * Threads which only share state through the library then go through exactly
+ * the same interleaving.
+ *
+ * The log is a 5-byte header followed by one or two variable-length integers
+ * per decision, typically 2 bytes per context switch.
+ */
+
+/*
+ * uthread_record_start - Start recording scheduler decisions
+ * @capacity: Size of the log in bytes. Recording stops once it is full
+ *
+ * Must be called before uthread_run(). A previous log is discarded.
+ *
+ * Return: -1 if @capacity is 0, if a replay is in progress, or in case of
+ * failure when allocating the log. 0 otherwise.
+ */
+int uthread_record_start(size_t capacity);
+
+/*
+ * uthread_record_stop - Stop recording scheduler decisions
+ *
+ * The log is kept until the next uthread_record_start() or
+ * uthread_replay_start().
+ */
+void uthread_record_stop(void);
+
+/*
+ * uthread_record_save - Write recorded log
+ * @out: Stream where to write the log
+ *
+ * Return: -1 if @out is NULL, if nothing was recorded, if the log got full, or
+ * in case of write error. Number of recorded decisions otherwise.
+ */
+long uthread_record_save(FILE *out);
+
+/*
+ * uthread_replay_start - Replay scheduler decisions
+ * @in: Stream where to read a log written by uthread_record_save()
+ *
+ * The next runs of the library replay the log, whatever their preemption
+ * options. Once the log has been replayed to its end, or once a run differs
+ * from it, threads are preempted every quantum ticks.
+ *
+ * Return: -1 if @in is NULL, if it doesn't hold a valid log, if recording is
+ * in progress, or in case of failure when allocating memory. 0 otherwise.
+ */
+int uthread_replay_start(FILE *in);
+
+/*
+ * uthread_replay_stop - Stop replaying scheduler decisions
+ * @replayed: Address where to store the number of decisions replayed before
+ *	the end of the log or the first difference, or NULL
+ *
+ * Return: 0 if the whole log was replayed without difference. -1 otherwise.
+ */
+int uthread_replay_stop(unsigned long *replayed);
+
+#endif /* _REPLAY_H */
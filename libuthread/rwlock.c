@@ -0,0 +1,128 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "queue.h"
+#include "rwlock.h"
+#include "private.h"
+
+struct uthread_rwlock {
+	size_t readers;		/* Number of threads holding the lock for reading */
+	bool writer;		/* Whether a thread holds the lock for writing */
+	queue_t read_q;		/* Readers waiting for the lock */
+	queue_t write_q;	/* Writers waiting for the lock */
+};
+
+uthread_rwlock_t uthread_rwlock_create(void)
+{
+	preempt_disable();
+	uthread_rwlock_t rwlock = malloc(sizeof(struct uthread_rwlock));
+
+	if (rwlock == NULL) {
+		preempt_enable();
+		return NULL;
+	}
+	rwlock->readers = 0;
+	rwlock->writer = false;
+	rwlock->read_q = queue_create();
+	rwlock->write_q = queue_create();
+	preempt_enable();
+
+	return rwlock;
+}
+
+int uthread_rwlock_destroy(uthread_rwlock_t rwlock)
+{
+	if (rwlock == NULL || rwlock->readers || rwlock->writer ||
+	    queue_length(rwlock->read_q) || queue_length(rwlock->write_q))
+		return -1;
+
+	preempt_disable();
+	queue_destroy(rwlock->read_q);
+	queue_destroy(rwlock->write_q);
+	free(rwlock);
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_rwlock_rdlock(uthread_rwlock_t rwlock)
+{
+	if (rwlock == NULL)
+		return -1;
+
+	preempt_disable();
+
+	/* Writer preference: queue up behind any active or waiting writer */
+	if (rwlock->writer || queue_length(rwlock->write_q) > 0) {
+		queue_enqueue(rwlock->read_q, uthread_current());
+		/* The releasing writer accounts for us before waking us up */
+		uthread_set_wait("rwlock", rwlock);
+		uthread_block();
+		return 0;
+	}
+	rwlock->readers++;
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_rwlock_wrlock(uthread_rwlock_t rwlock)
+{
+	if (rwlock == NULL)
+		return -1;
+
+	preempt_disable();
+
+	if (rwlock->writer || rwlock->readers > 0) {
+		queue_enqueue(rwlock->write_q, uthread_current());
+		/* Ownership is handed over to us by the last holder */
+		uthread_set_wait("rwlock", rwlock);
+		uthread_block();
+		return 0;
+	}
+	rwlock->writer = true;
+	preempt_enable();
+
+	return 0;
+}
+
+int uthread_rwlock_unlock(uthread_rwlock_t rwlock)
+{
+	struct uthread_tcb *next;
+
+	if (rwlock == NULL)
+		return -1;
+
+	preempt_disable();
+
+	if (rwlock->writer) {
+		rwlock->writer = false;
+	} else if (rwlock->readers > 0) {
+		/* Other readers still hold the lock */
+		if (--rwlock->readers > 0) {
+			preempt_enable();
+			return 0;
+		}
+	} else {
+		preempt_enable();
+		return -1;
+	}
+
+	/* Lock is free: hand it over to the oldest writer first */
+	if (queue_dequeue(rwlock->write_q, (void **) &next) == 0) {
+		rwlock->writer = true;
+		uthread_unblock(next);
+		return 0;
+	}
+
+	/* No writer waiting: grant the lock to all the readers in one go */
+	if (queue_length(rwlock->read_q) > 0) {
+		rwlock->readers = queue_length(rwlock->read_q);
+		uthread_unblock_all(rwlock->read_q);
+		return 0;
+	}
+	preempt_enable();
+
+	return 0;
+}
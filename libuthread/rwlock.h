@@ -0,0 +1,68 @@
+#ifndef _RWLOCK_H
+#define _RWLOCK_H
+
+/*
+ * uthread_rwlock_t - Reader-writer lock type
+ *
+ * A reader-writer lock lets any number of threads hold the lock for reading at
+ * the same time, while a thread holding the lock for writing has exclusive
+ * access. Writers are preferred: as soon as a writer is waiting, new readers
+ * are queued behind it instead of joining the current readers.
+ */
+typedef struct uthread_rwlock *uthread_rwlock_t;
+
+/*
+ * uthread_rwlock_create - Create reader-writer lock
+ *
+ * Allocate and initialize an unlocked reader-writer lock.
+ *
+ * Return: Pointer to initialized lock. NULL in case of failure when allocating
+ * the new lock.
+ */
+uthread_rwlock_t uthread_rwlock_create(void);
+
+/*
+ * uthread_rwlock_destroy - Deallocate a reader-writer lock
+ * @rwlock: Lock to deallocate
+ *
+ * Return: -1 if @rwlock is NULL, if it is held or if threads are still waiting
+ * on it. 0 if @rwlock was successfully destroyed.
+ */
+int uthread_rwlock_destroy(uthread_rwlock_t rwlock);
+
+/*
+ * uthread_rwlock_rdlock - Take a reader-writer lock for reading
+ * @rwlock: Lock to take
+ *
+ * The caller thread is blocked while a writer holds @rwlock or while writers
+ * are waiting for it.
+ *
+ * Return: -1 if @rwlock is NULL. 0 if @rwlock was successfully taken.
+ */
+int uthread_rwlock_rdlock(uthread_rwlock_t rwlock);
+
+/*
+ * uthread_rwlock_wrlock - Take a reader-writer lock for writing
+ * @rwlock: Lock to take
+ *
+ * The caller thread is blocked until no other thread holds @rwlock.
+ *
+ * Return: -1 if @rwlock is NULL. 0 if @rwlock was successfully taken.
+ */
+int uthread_rwlock_wrlock(uthread_rwlock_t rwlock);
+
+/*
+ * uthread_rwlock_unlock - Release a reader-writer lock
+ * @rwlock: Lock to release
+ *
+ * Release @rwlock, held either for reading or for writing. When the last
+ * holder leaves, the lock is handed over to the oldest waiting writer if any.
+ * Otherwise, all the waiting readers are granted the lock and made ready at
+ * once.
+ *
+ * Return: -1 if @rwlock is NULL or not held. 0 if @rwlock was successfully
+ * released.
+ */
+int uthread_rwlock_unlock(uthread_rwlock_t rwlock);
+
+#endif /* _RWLOCK_H */
@@ -1,5 +1,10 @@
+#include <errno.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "queue.h"
 #include "sem.h"
@@ -9,6 +14,35 @@ struct semaphore {
     /* Phase 3 */
     size_t count;
     queue_t wait_q;
+    char name[SEM_NAME_MAX];
+#ifdef UTHREAD_STATS
+    struct sem_profile profile;
+#endif
+};
+
+#ifdef UTHREAD_STATS
+/* All existing semaphores, for contention reports */
+static queue_t sem_registry;
+
+/* Record wait of @ns on @sem */
+static void sem_profile_wait(sem_t sem, uint64_t ns)
+{
+    int bucket = 0;
+
+    while (bucket < SEM_WAIT_BUCKETS - 1 && ns >> (bucket + 1)){
+        bucket++;
+    }
+    sem->profile.wait_hist[bucket]++;
+    sem->profile.wait_ns += ns;
+}
+#endif
+
+/* Thread waiting in the wait queue of a semaphore */
+struct sem_waiter {
+    struct uthread_tcb *thread;
+    sem_t sem;
+    size_t n;           /* Number of resources requested */
+    bool timed_out;
 };
 
 sem_t sem_create(size_t count)
@@ -20,10 +54,21 @@ sem_t sem_create(size_t count)
 
     /* Return NULL if sem is NULL */
     if (sem == NULL){
+        preempt_enable();
         return NULL;
     }
+    /* Timed-out waiters leave from any position: delete them in O(1) */
+    sem->wait_q = queue_create_indexed();
+    sem->name[0] = '\0';
+#ifdef UTHREAD_STATS
+    memset(&sem->profile, 0, sizeof(sem->profile));
+    /* Semaphores are destroyed in any order: delete them in O(1) */
+    if (sem_registry == NULL){
+        sem_registry = queue_create_indexed();
+    }
+    queue_enqueue(sem_registry, sem);
+#endif
     preempt_enable();
-    sem->wait_q = queue_create();
     sem->count = count;
 
     return sem;
@@ -37,10 +82,152 @@ int sem_destroy(sem_t sem)
     
     /* Return -1 if sem is NULL or if other threads are still being blocked on sem */
     if (sem == NULL || queue_destroy(sem->wait_q) == -1){
+        preempt_enable();
         return -1;
     }
-    preempt_enable();
+#ifdef UTHREAD_STATS
+    queue_delete(sem_registry, sem);
+#endif
     free(sem);
+    preempt_enable();
+
+    return 0;
+}
+
+/*
+ * sem_grant_waiter - Grant resources to waiter if enough are available
+ *
+ * Return: 1 to stop sem_grant() at this waiter, 0 otherwise
+ */
+static int sem_grant_waiter(queue_t wait_q, void *data)
+{
+    struct sem_waiter *waiter = (struct sem_waiter *) data;
+
+    /* Stop at the first waiter which can't be fulfilled */
+    if (waiter->n > waiter->sem->count){
+        return 1;
+    }
+    waiter->sem->count -= waiter->n;
+    queue_delete(wait_q, waiter);
+    uthread_ready(waiter->thread);
+
+    return 0;
+}
+
+/*
+ * sem_grant - Hand available resources over to waiters
+ * @sem: Semaphore
+ *
+ * Resources are granted to waiters in FIFO order and only as a whole: the
+ * oldest waiter blocks the ones behind it until enough resources are available
+ * to fulfill its request. Granted waiters are made ready. Must be called with
+ * preemption disabled.
+ */
+static void sem_grant(sem_t sem)
+{
+    /* Single pass over the wait queue */
+    queue_iterate_until(sem->wait_q, sem_grant_waiter, NULL);
+}
+
+/*
+ * sem_timeout - Timer callback of a waiter whose timeout expired
+ */
+static void sem_timeout(void *arg)
+{
+    struct sem_waiter *waiter = (struct sem_waiter *) arg;
+
+    /* Only wake the waiter up if it was not granted its resources already */
+    if (queue_delete(waiter->sem->wait_q, waiter) == 0){
+        waiter->timed_out = true;
+        uthread_ready(waiter->thread);
+        /* Waiters behind might have been held back by this one */
+        sem_grant(waiter->sem);
+    }
+}
+
+/*
+ * sem_take - Take resources if available right away
+ * @sem: Semaphore to take
+ * @n: Number of resources to take
+ *
+ * Resources are not taken if older waiters are queued for them. Must be called
+ * with preemption disabled.
+ *
+ * Return: true if resources were taken, false otherwise
+ */
+static bool sem_take(sem_t sem, size_t n)
+{
+    if (sem->count >= n && queue_length(sem->wait_q) == 0){
+        sem->count -= n;
+#ifdef UTHREAD_STATS
+        sem->profile.acquisitions++;
+#endif
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * sem_wait - Take resources from a semaphore, waiting at most until @timer
+ * expires
+ * @sem: Semaphore to take
+ * @n: Number of resources to take
+ * @timer: Timer to arm while waiting, or NULL to wait forever
+ * @deadline: Expiration time of @timer
+ *
+ * Must be called with preemption disabled, and returns with preemption enabled.
+ */
+static int sem_wait(sem_t sem, size_t n, struct uthread_timer *timer,
+                    uint64_t deadline)
+{
+    struct sem_waiter waiter = { uthread_current(), sem, n, false };
+
+    trace_record(TRACE_SEM_DOWN, uthread_self(), (uintptr_t) sem);
+    if (sem_take(sem, n)){
+        preempt_enable();
+        return 0;
+    }
+
+    /* Otherwise, the current running thread is added into the wait queue and
+     * blocked until sem_grant() hands the resources over to it
+     */
+    if (timer && timer_start(timer, deadline, sem_timeout, &waiter)){
+        preempt_enable();
+        errno = ENOMEM;
+        return -1;
+    }
+    uthread_stats_sem_wait();
+    queue_enqueue(sem->wait_q, &waiter);
+#ifdef UTHREAD_STATS
+    uint64_t start = timer_now();
+    size_t depth = queue_length(sem->wait_q);
+
+    sem->profile.contended++;
+    if (depth > sem->profile.max_depth){
+        sem->profile.max_depth = depth;
+    }
+#endif
+    uthread_set_wait("sem", sem);
+    uthread_block();
+
+#ifdef UTHREAD_STATS
+    preempt_disable();
+    sem_profile_wait(sem, timer_now() - start);
+    if (!waiter.timed_out){
+        sem->profile.acquisitions++;
+    }
+    preempt_enable();
+#endif
+    if (timer){
+        preempt_disable();
+        timer_cancel(timer);
+        preempt_enable();
+    }
+    if (waiter.timed_out){
+        errno = ETIMEDOUT;
+        return -1;
+    }
 
     return 0;
 }
@@ -48,46 +235,216 @@ int sem_destroy(sem_t sem)
 int sem_down(sem_t sem)
 {
     /* Phase 3 */
+    return sem_down_n(sem, 1);
+}
+
+int sem_down_n(sem_t sem, size_t n)
+{
     /* Return -1 if sem is NULL */
     if (sem == NULL){
+        errno = EINVAL;
         return -1;
     }
-    /* When the requested resource is not available, the current 
-     * running thread is added into the wait queue and blocked
-     */
-    while (sem->count == 0){
-        struct uthread_tcb *running_thread = uthread_current();
-        queue_enqueue(sem->wait_q, running_thread);
-        uthread_block();
+    preempt_disable();
+
+    return sem_wait(sem, n, NULL, 0);
+}
+
+int sem_trydown(sem_t sem)
+{
+    if (sem == NULL){
+        errno = EINVAL;
+        return -1;
     }
-    /* Take resource */
-    if (sem->count > 0){
-    	sem->count--;
+    preempt_disable();
+    if (!sem_take(sem, 1)){
+        preempt_enable();
+        errno = EAGAIN;
+        return -1;
     }
-    
+    preempt_enable();
+
     return 0;
 }
 
+int sem_down_timeout(sem_t sem, uint64_t timeout_ns)
+{
+    struct uthread_timer timer;
+
+    if (sem == NULL){
+        errno = EINVAL;
+        return -1;
+    }
+    /* Don't arm a timer for a plain try */
+    if (timeout_ns == 0){
+        if (sem_trydown(sem) == 0){
+            return 0;
+        }
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    preempt_disable();
+
+    return sem_wait(sem, 1, &timer, timer_now() + timeout_ns);
+}
+
 int sem_up(sem_t sem)
 {
     /* Phase 3 */
+    return sem_up_n(sem, 1);
+}
+
+int sem_up_n(sem_t sem, size_t n)
+{
     /* Return -1 if sem is NULL */
     if (sem == NULL){
+        errno = EINVAL;
         return -1;
     }
-    /* If the wait queue is not empty at the time of release,
-     * the first thread in the wait queue is unblocked 
-     */
-    if (queue_length(sem->wait_q) > 0){
-        struct uthread_tcb *head;
-        if (queue_dequeue(sem->wait_q, (void**) &head) == -1){
-            return -1;
+    preempt_disable();
+    trace_record(TRACE_SEM_UP, uthread_self(), (uintptr_t) sem);
+
+    /* Release resources */
+    sem->count += n;
+
+    /* Wake all the waiters that can now be satisfied at once */
+    sem_grant(sem);
+    preempt_enable();
+
+    return 0;
+}
+
+int sem_set_name(sem_t sem, const char *name)
+{
+    if (sem == NULL || name == NULL){
+        return -1;
+    }
+    preempt_disable();
+    snprintf(sem->name, sizeof(sem->name), "%s", name);
+    preempt_enable();
+
+    return 0;
+}
+
+#ifdef UTHREAD_STATS
+/* Profile of @sem, must be called with preemption disabled */
+static void sem_profile_snapshot(sem_t sem, struct sem_profile *profile)
+{
+    *profile = sem->profile;
+    memcpy(profile->name, sem->name, sizeof(profile->name));
+    profile->depth = queue_length(sem->wait_q);
+}
+
+/* Semaphores collected by sem_profile_report() */
+static sem_t *report_sems;
+static size_t report_len;
+
+static void sem_collect(queue_t queue, void *data)
+{
+    (void)queue;
+    report_sems[report_len++] = data;
+}
+
+/* Most contended first, then longest total wait first */
+static int sem_cmp_contention(const void *a, const void *b)
+{
+    const struct sem_profile *x = &(*(const sem_t *) a)->profile;
+    const struct sem_profile *y = &(*(const sem_t *) b)->profile;
+
+    if (x->contended != y->contended){
+        return x->contended < y->contended ? 1 : -1;
+    }
+    if (x->wait_ns != y->wait_ns){
+        return x->wait_ns < y->wait_ns ? 1 : -1;
+    }
+
+    return 0;
+}
+
+/* Upper bound of wait time at percentile @p of histogram */
+static uint64_t sem_wait_percentile(const struct sem_profile *profile, int p)
+{
+    unsigned long seen = 0, rank;
+    int i;
+
+    rank = (profile->contended * p + 99) / 100;
+    for (i = 0; i < SEM_WAIT_BUCKETS - 1; i++){
+        seen += profile->wait_hist[i];
+        if (seen >= rank){
+            break;
         }
-        uthread_unblock(head);
     }
-    /* Release resource */
-    sem->count++;
+
+    return (2ULL << i) - 1;
+}
+#endif
+
+int sem_profile(sem_t sem, struct sem_profile *profile)
+{
+#ifdef UTHREAD_STATS
+    if (sem == NULL || profile == NULL){
+        return -1;
+    }
+    preempt_disable();
+    sem_profile_snapshot(sem, profile);
+    preempt_enable();
 
     return 0;
+#else
+    (void) sem;
+    (void) profile;
+    return -1;
+#endif
 }
 
+int sem_profile_report(FILE *out, size_t n)
+{
+#ifdef UTHREAD_STATS
+    struct sem_profile profile;
+    size_t i;
+
+    if (out == NULL){
+        return -1;
+    }
+
+    /* Sort a snapshot of the registry */
+    preempt_disable();
+    report_len = 0;
+    report_sems = malloc((queue_length(sem_registry) + 1) * sizeof(sem_t));
+    if (report_sems == NULL){
+        preempt_enable();
+        return -1;
+    }
+    queue_iterate(sem_registry, sem_collect);
+    qsort(report_sems, report_len, sizeof(sem_t), sem_cmp_contention);
+    if (n > report_len){
+        n = report_len;
+    }
+
+    fprintf(out, "%-*s %12s %12s %9s %12s %12s\n", SEM_NAME_MAX - 1,
+            "semaphore", "acquired", "contended", "max_depth", "mean_wait_ns",
+            "p99_wait_ns");
+    for (i = 0; i < n; i++){
+        sem_profile_snapshot(report_sems[i], &profile);
+        if (profile.name[0] == '\0'){
+            snprintf(profile.name, sizeof(profile.name), "%p",
+                     (void *) report_sems[i]);
+        }
+        fprintf(out, "%-*s %12lu %12lu %9zu %12llu %12llu\n",
+                SEM_NAME_MAX - 1, profile.name, profile.acquisitions,
+                profile.contended, profile.max_depth,
+                profile.contended ? (unsigned long long)
+                (profile.wait_ns / profile.contended) : 0ULL,
+                profile.contended ? (unsigned long long)
+                sem_wait_percentile(&profile, 99) : 0ULL);
+    }
+    free(report_sems);
+    preempt_enable();
+
+    return n;
+#else
+    (void) out;
+    (void) n;
+    return -1;
+#endif
+}
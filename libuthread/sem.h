@@ -2,6 +2,7 @@
 #define _SEMAPHORE_H
 
 #include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 
 /*
@@ -50,6 +51,32 @@ int sem_destroy(sem_t sem);
  */
 int sem_down(sem_t sem);
 
+/*
+ * sem_trydown - Take a semaphore without blocking
+ * @sem: Semaphore to take
+ *
+ * Take a resource from semaphore @sem if one is available right away.
+ *
+ * Return: -1 if @sem is NULL (errno set to EINVAL) or if no resource is
+ * available (errno set to EAGAIN). 0 if semaphore was successfully taken.
+ */
+int sem_trydown(sem_t sem);
+
+/*
+ * sem_down_timeout - Take a semaphore, waiting for a limited time
+ * @sem: Semaphore to take
+ * @timeout_ns: Maximum time to wait, in nanoseconds
+ *
+ * Same as sem_down(), except that the caller thread gives up if the semaphore
+ * is still unavailable after @timeout_ns nanoseconds. The timeout is measured
+ * on the monotonic clock.
+ *
+ * Return: -1 if @sem is NULL (errno set to EINVAL), if the timeout expired
+ * (errno set to ETIMEDOUT), or in case of memory allocation error when arming
+ * the timeout (errno set to ENOMEM). 0 if semaphore was successfully taken.
+ */
+int sem_down_timeout(sem_t sem, uint64_t timeout_ns);
+
 /*
  * sem_up - Release a semaphore
  * @sem: Semaphore to release
@@ -64,4 +91,111 @@ int sem_down(sem_t sem);
  */
 int sem_up(sem_t sem);
 
+/*
+ * sem_up_external - Release a semaphore from another OS thread
+ * @sem: Semaphore to release
+ *
+ * Same as sem_up(), except that this function can safely be called from any OS
+ * thread of the process, for instance from a pthread, while the library is
+ * running. The semaphore is released asynchronously, the next time the library
+ * is idle.
+ *
+ * Return: -1 if @sem is NULL, in case of memory allocation error, or if the
+ * library is not running. 0 if the release was successfully posted.
+ */
+int sem_up_external(sem_t sem);
+
+/*
+ * sem_down_n - Take several resources from a semaphore
+ * @sem: Semaphore to take
+ * @n: Number of resources to take
+ *
+ * Take @n resources from semaphore @sem at once. Resources are never taken
+ * partially: the caller thread is blocked until all @n resources can be taken
+ * together. Waiting threads are served in FIFO order, so that a large request
+ * cannot be starved by smaller ones arriving after it.
+ *
+ * Return: -1 if @sem is NULL. 0 if the resources were successfully taken.
+ */
+int sem_down_n(sem_t sem, size_t n);
+
+/*
+ * sem_up_n - Release several resources to a semaphore
+ * @sem: Semaphore to release
+ * @n: Number of resources to release
+ *
+ * Release @n resources to semaphore @sem at once. All the waiting threads whose
+ * requests can be fulfilled with the released resources are unblocked in the
+ * same operation.
+ *
+ * Return: -1 if @sem is NULL. 0 if the resources were successfully released.
+ */
+int sem_up_n(sem_t sem, size_t n);
+
+/* Maximum length of a semaphore name, including the terminating null byte */
+#define SEM_NAME_MAX 32
+
+/*
+ * sem_set_name - Name a semaphore
+ * @sem: Semaphore to name
+ * @name: Name of @sem, truncated to SEM_NAME_MAX - 1 characters
+ *
+ * The name identifies @sem in contention reports and thread dumps.
+ *
+ * Return: -1 if @sem or @name are NULL. 0 otherwise.
+ */
+int sem_set_name(sem_t sem, const char *name);
+
+/* Number of buckets of wait time histograms */
+#define SEM_WAIT_BUCKETS 32
+
+/*
+ * struct sem_profile - Contention profile of a semaphore
+ * @name: Name of semaphore, empty if it wasn't named
+ * @acquisitions: Number of successful downs
+ * @contended: Number of downs which had to wait, whether they succeeded or
+ *	timed out
+ * @depth: Number of threads currently waiting
+ * @max_depth: Maximum number of threads waiting at once
+ * @wait_ns: Total time spent waiting, in nanoseconds
+ * @wait_hist: Histogram of wait times: bucket i counts the waits which lasted
+ *	from 2^i to 2^(i+1) - 1 nanoseconds, the last bucket all the longer ones
+ */
+struct sem_profile {
+	char name[SEM_NAME_MAX];
+	unsigned long acquisitions;
+	unsigned long contended;
+	size_t depth;
+	size_t max_depth;
+	uint64_t wait_ns;
+	unsigned long wait_hist[SEM_WAIT_BUCKETS];
+};
+
+/*
+ * sem_profile - Get contention profile of a semaphore
+ * @sem: Semaphore
+ * @profile: Address where to store the profile of @sem
+ *
+ * Semaphores are only profiled if the library was built with UTHREAD_STATS
+ * defined (`make STATS=1`).
+ *
+ * Return: -1 if semaphores are not profiled, or if @sem or @profile are NULL.
+ * 0 otherwise.
+ */
+int sem_profile(sem_t sem, struct sem_profile *profile);
+
+/*
+ * sem_profile_report - Print the most contended semaphores
+ * @out: Stream where to print the report
+ * @n: Maximum number of semaphores to list
+ *
+ * List the @n existing semaphores with the most contended downs, along with
+ * their acquisitions, maximum wait queue depth, and mean and 99th percentile
+ * wait time. Percentiles are upper bounds of histogram buckets.
+ *
+ * Return: -1 if semaphores are not profiled or if @out is NULL. Number of
+ * semaphores listed otherwise.
+ */
+int sem_profile_report(FILE *out, size_t n);
+
 #endif /* _SEMAPHORE_H */
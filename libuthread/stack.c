@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "private.h"
+#include "stack.h"
+
+/* Recommended sizes are rounded up to pages */
+#define STACK_PAGE 4096
+
+bool stack_watched;
+
+/* Usage of each measured function, in order of first measure */
+static struct uthread_stack_usage *stack_usages;
+static size_t stack_len, stack_capacity;
+
+void uthread_stack_watch(bool enable)
+{
+	stack_watched = enable;
+}
+
+static struct uthread_stack_usage *stack_find(uthread_func_t func)
+{
+	size_t i;
+
+	for (i = 0; i < stack_len; i++)
+		if (stack_usages[i].func == func)
+			return &stack_usages[i];
+
+	return NULL;
+}
+
+void stack_record(uthread_func_t func, size_t used)
+{
+	struct uthread_stack_usage *usage = stack_find(func);
+	size_t bucket;
+
+	if (usage == NULL) {
+		if (stack_len == stack_capacity) {
+			size_t capacity = stack_capacity ? 2 * stack_capacity : 8;
+			void *usages = realloc(stack_usages,
+					       capacity * sizeof(*stack_usages));
+
+			/* Measure lost */
+			if (usages == NULL)
+				return;
+			stack_usages = usages;
+			stack_capacity = capacity;
+		}
+		usage = &stack_usages[stack_len++];
+		memset(usage, 0, sizeof(*usage));
+		usage->func = func;
+	}
+
+	bucket = used / UTHREAD_STACK_BUCKET;
+	if (bucket >= UTHREAD_STACK_BUCKETS)
+		bucket = UTHREAD_STACK_BUCKETS - 1;
+	usage->hist[bucket]++;
+	usage->threads++;
+	if (used > usage->max_bytes) {
+		usage->max_bytes = used;
+		usage->recommended_bytes = (used + used / 2 + STACK_PAGE - 1) /
+			STACK_PAGE * STACK_PAGE;
+	}
+}
+
+int uthread_stack_usage(uthread_func_t func, struct uthread_stack_usage *usage)
+{
+	struct uthread_stack_usage *found;
+
+	if (usage == NULL)
+		return -1;
+
+	preempt_disable();
+	found = stack_find(func);
+	if (found)
+		*usage = *found;
+	preempt_enable();
+
+	return found ? 0 : -1;
+}
+
+size_t uthread_stack_recommended(void)
+{
+	size_t i, size = 0;
+
+	preempt_disable();
+	for (i = 0; i < stack_len; i++)
+		if (stack_usages[i].recommended_bytes > size)
+			size = stack_usages[i].recommended_bytes;
+	preempt_enable();
+
+	return size;
+}
+
+int uthread_stack_report(FILE *out)
+{
+	Dl_info info;
+	size_t i;
+
+	if (out == NULL)
+		return -1;
+
+	preempt_disable();
+	fprintf(out, "%-32s %10s %10s %12s\n", "function", "threads",
+		"max_bytes", "recommended");
+	for (i = 0; i < stack_len; i++) {
+		struct uthread_stack_usage *usage = &stack_usages[i];
+
+		if (dladdr((void *)usage->func, &info) && info.dli_sname)
+			fprintf(out, "%-32s", info.dli_sname);
+		else
+			fprintf(out, "%-32p", (void *)usage->func);
+		fprintf(out, " %10lu %10zu %12zu\n", usage->threads,
+			usage->max_bytes, usage->recommended_bytes);
+	}
+	preempt_enable();
+
+	return stack_len;
+}
+
+void uthread_stack_reset(void)
+{
+	preempt_disable();
+	free(stack_usages);
+	stack_usages = NULL;
+	stack_len = 0;
+	stack_capacity = 0;
+	preempt_enable();
+}
@@ -0,0 +1,87 @@
+#ifndef _STACK_H
+#define _STACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "uthread.h"
+
+/*
+ * Stack usage measurement
+ *
+ * While stack watching is enabled, the stacks of new threads are filled with a
+ * canary pattern. When a thread has exited, the deepest word of its stack which
+ * no longer holds the pattern gives its high-water mark, which is accounted to
+ * the function the thread was created with.
+ */
+
+/* Size of the stack of a thread, in bytes */
+#define UTHREAD_STACK_SIZE 32768
+
+/* Granularity of stack usage histograms, in bytes */
+#define UTHREAD_STACK_BUCKET 1024
+#define UTHREAD_STACK_BUCKETS (UTHREAD_STACK_SIZE / UTHREAD_STACK_BUCKET)
+
+/*
+ * struct uthread_stack_usage - Stack usage of the threads of a function
+ * @func: Function the threads were created with
+ * @threads: Number of measured threads
+ * @max_bytes: Highest high-water mark, in bytes
+ * @recommended_bytes: Recommended stack size for these threads: the highest
+ *	high-water mark plus half of it, rounded up to a multiple of 4 KiB
+ * @hist: Histogram of high-water marks: bucket i counts the threads which
+ *	used from i to i + 1 times UTHREAD_STACK_BUCKET bytes
+ */
+struct uthread_stack_usage {
+	uthread_func_t func;
+	unsigned long threads;
+	size_t max_bytes;
+	size_t recommended_bytes;
+	unsigned long hist[UTHREAD_STACK_BUCKETS];
+};
+
+/*
+ * uthread_stack_watch - Enable or disable stack watching
+ * @enable: Whether to fill the stacks of new threads with the canary pattern
+ *
+ * Only threads created while stack watching is enabled get measured. Filling
+ * a stack costs a pass over it when creating the thread, and measuring it
+ * another one when it has exited.
+ */
+void uthread_stack_watch(bool enable);
+
+/*
+ * uthread_stack_usage - Get stack usage of the threads of a function
+ * @func: Function the threads were created with
+ * @usage: Address where to store the stack usage
+ *
+ * Measures are kept across runs of the library, until uthread_stack_reset().
+ *
+ * Return: -1 if @usage is NULL or if no thread of @func was measured. 0
+ * otherwise.
+ */
+int uthread_stack_usage(uthread_func_t func, struct uthread_stack_usage *usage);
+
+/*
+ * uthread_stack_recommended - Get recommended stack size for all threads
+ *
+ * Return: Largest recommended size over all measured functions, 0 if no thread
+ * was measured
+ */
+size_t uthread_stack_recommended(void);
+
+/*
+ * uthread_stack_report - Print stack usage of all measured functions
+ * @out: Stream where to print the report
+ *
+ * Return: -1 if @out is NULL. Number of functions listed otherwise.
+ */
+int uthread_stack_report(FILE *out);
+
+/*
+ * uthread_stack_reset - Discard measures
+ */
+void uthread_stack_reset(void);
+
+#endif /* _STACK_H */
@@ -0,0 +1,83 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "pqueue.h"
+#include "private.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+/* Armed timers, by deadline (oldest first for equal deadlines) */
+static pqueue_t timers;
+
+uint64_t timer_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+int timer_start(struct uthread_timer *timer, uint64_t deadline,
+		void (*func)(void *arg), void *arg)
+{
+	if (timers == NULL) {
+		timers = pqueue_create(0);
+		if (timers == NULL)
+			return -1;
+	}
+
+	timer->func = func;
+	timer->arg = arg;
+
+	return pqueue_insert(timers, &timer->node, deadline);
+}
+
+void timer_cancel(struct uthread_timer *timer)
+{
+	pqueue_delete(timers, &timer->node);
+}
+
+void timer_run(void)
+{
+	uint64_t now = timer_now();
+	/* When replaying, fire as many timers as the recorded run did */
+	long replayed = replay_timers();
+	unsigned long fired = 0;
+
+	while (1) {
+		struct pqueue_node *node;
+		struct uthread_timer *timer;
+
+		preempt_disable();
+		if (pqueue_peek(timers, &node))
+			break;
+		if (replayed >= 0 ? fired == (unsigned long)replayed :
+		    node->key > now)
+			break;
+		pqueue_pop(timers, &node);
+		fired++;
+
+		/* Callback may enable preemption again */
+		timer = pqueue_entry(node, struct uthread_timer, node);
+		timer->func(timer->arg);
+	}
+	replay_timers_fired(fired);
+	preempt_enable();
+}
+
+int timer_next(uint64_t *deadline)
+{
+	struct pqueue_node *node;
+
+	preempt_disable();
+	if (pqueue_peek(timers, &node)) {
+		preempt_enable();
+		return -1;
+	}
+	*deadline = node->key;
+	preempt_enable();
+
+	return 0;
+}
@@ -0,0 +1,177 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "private.h"
+#include "trace.h"
+
+struct trace_event {
+	uint64_t ts;		/* Timestamp counter */
+	uint32_t type;
+	uint32_t tid;
+	uint64_t arg;
+};
+
+static const char *const trace_names[] = {
+	[TRACE_CREATE] = "create",
+	[TRACE_RUN] = "run",
+	[TRACE_YIELD] = "yield",
+	[TRACE_PREEMPT] = "preempt",
+	[TRACE_BLOCK] = "block",
+	[TRACE_UNBLOCK] = "unblock",
+	[TRACE_EXIT] = "exit",
+	[TRACE_SEM_DOWN] = "sem_down",
+	[TRACE_SEM_UP] = "sem_up",
+};
+
+/* Name of the argument of each event type, if any */
+static const char *const trace_args[] = {
+	[TRACE_CREATE] = "child",
+	[TRACE_UNBLOCK] = "by",
+	[TRACE_SEM_DOWN] = "sem",
+	[TRACE_SEM_UP] = "sem",
+};
+
+bool trace_on;
+
+/* Ring buffer, of a power of two size */
+static struct trace_event *trace_buf;
+static size_t trace_mask;
+static uint64_t trace_head;	/* Number of events recorded so far */
+
+/* Reference points of the timestamp counter and of the monotonic clock */
+static uint64_t trace_base_ts, trace_base_ns;
+
+static uint64_t trace_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return timer_now();
+#endif
+}
+
+void trace_add(int type, uthread_t tid, uint64_t arg)
+{
+	struct trace_event *e = &trace_buf[trace_head++ & trace_mask];
+
+	e->ts = trace_clock();
+	e->type = type;
+	e->tid = tid;
+	e->arg = arg;
+}
+
+int uthread_trace_enable(size_t capacity)
+{
+	size_t size = 1;
+
+	if (capacity == 0)
+		return -1;
+
+	preempt_disable();
+	if (trace_buf == NULL) {
+		while (size < capacity)
+			size <<= 1;
+		trace_buf = malloc(size * sizeof(*trace_buf));
+		if (trace_buf == NULL) {
+			preempt_enable();
+			return -1;
+		}
+		trace_mask = size - 1;
+		trace_head = 0;
+		trace_base_ts = trace_clock();
+		trace_base_ns = timer_now();
+	}
+	trace_on = true;
+	preempt_enable();
+
+	return 0;
+}
+
+void uthread_trace_disable(void)
+{
+	trace_on = false;
+}
+
+void uthread_trace_reset(void)
+{
+	preempt_disable();
+	trace_on = false;
+	free(trace_buf);
+	trace_buf = NULL;
+	preempt_enable();
+}
+
+/* Emit Chrome complete event for running period of a thread */
+static void trace_dump_run(FILE *out, uint32_t tid, double start_us,
+			   double end_us)
+{
+	fprintf(out, ",\n{\"name\": \"run\", \"ph\": \"X\", \"pid\": 1, "
+		"\"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+		tid, start_us, end_us - start_us);
+}
+
+int uthread_trace_dump(FILE *out)
+{
+	uint64_t first, i, now_ts, now_ns;
+	double ns_per_tick = 1, start_us = 0;
+	bool running = false;
+	uint32_t run_tid = 0;
+
+	if (out == NULL || trace_buf == NULL)
+		return -1;
+
+	preempt_disable();
+	first = trace_head > trace_mask ? trace_head - trace_mask - 1 : 0;
+
+	/* Calibrate timestamp counter against the monotonic clock */
+	now_ts = trace_clock();
+	now_ns = timer_now();
+	if (now_ts != trace_base_ts)
+		ns_per_tick = (double)(now_ns - trace_base_ns) /
+			(now_ts - trace_base_ts);
+
+	fprintf(out, "[\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+		"\"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"idle\"}}");
+	for (i = first; i < trace_head; i++) {
+		struct trace_event *e = &trace_buf[i & trace_mask];
+		double us = (e->ts - trace_base_ts) * ns_per_tick / 1000;
+
+		/* A thread runs until the next one does */
+		if (e->type == TRACE_RUN) {
+			if (running)
+				trace_dump_run(out, run_tid, start_us, us);
+			running = true;
+			run_tid = e->tid;
+			start_us = us;
+			continue;
+		}
+
+		fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"t\", "
+			"\"pid\": 1, \"tid\": %u, \"ts\": %.3f",
+			trace_names[e->type], e->tid, us);
+		if (e->type == TRACE_SEM_DOWN || e->type == TRACE_SEM_UP)
+			fprintf(out, ", \"args\": {\"%s\": \"%#llx\"}",
+				trace_args[e->type], (unsigned long long)e->arg);
+		else if (trace_args[e->type])
+			fprintf(out, ", \"args\": {\"%s\": %llu}",
+				trace_args[e->type], (unsigned long long)e->arg);
+		fprintf(out, "}");
+		if (e->type == TRACE_EXIT && running && e->tid == run_tid) {
+			trace_dump_run(out, run_tid, start_us, us);
+			running = false;
+		}
+	}
+	if (running)
+		trace_dump_run(out, run_tid, start_us,
+			       (now_ts - trace_base_ts) * ns_per_tick / 1000);
+	fprintf(out, "\n]\n");
+	preempt_enable();
+
+	return trace_head - first;
+}
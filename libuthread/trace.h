@@ -0,0 +1,63 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Scheduler tracing
+ *
+ * While tracing is enabled, the scheduler records its events into a ring
+ * buffer: thread creation, run, yield, preemption, block, unblock and exit, and
+ * semaphore downs and ups. Once full, the buffer overwrites its oldest events.
+ * Recording an event only costs a timestamp and a few stores; while tracing is
+ * disabled, it costs a test.
+ *
+ * Events are timestamped with the CPU timestamp counter where available,
+ * converted to nanoseconds when dumped. Thread identifiers start from 1 again
+ * with each run of the library, so a buffer is best dumped before the next run.
+ */
+
+/*
+ * uthread_trace_enable - Start recording scheduler events
+ * @capacity: Number of events the ring buffer holds, rounded up to a power of
+ *	two. Only used to allocate the buffer the first time, or after
+ *	uthread_trace_reset()
+ *
+ * Can be called before uthread_run() or from any thread.
+ *
+ * Return: -1 if @capacity is 0 or in case of failure when allocating the
+ * buffer. 0 otherwise.
+ */
+int uthread_trace_enable(size_t capacity);
+
+/*
+ * uthread_trace_disable - Stop recording scheduler events
+ *
+ * Events recorded so far are kept, and recording goes on from where it stopped
+ * when tracing is enabled again.
+ */
+void uthread_trace_disable(void);
+
+/*
+ * uthread_trace_reset - Discard recorded events
+ *
+ * Tracing is disabled and the ring buffer is deallocated.
+ */
+void uthread_trace_reset(void);
+
+/*
+ * uthread_trace_dump - Write recorded events in Chrome trace-event format
+ * @out: Stream where to write the events
+ *
+ * The events are written oldest first, as a JSON array that can be opened with
+ * Perfetto or chrome://tracing: running periods of each thread as complete
+ * events, all the other events as instant events.
+ *
+ * Return: -1 if @out is NULL or if no buffer was allocated. Number of recorded
+ * events otherwise.
+ */
+int uthread_trace_dump(FILE *out);
+
+#endif /* _TRACE_H */
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 
 #include "private.h"
@@ -26,57 +27,240 @@ typedef struct uthread_tcb {
         int state;
         uthread_ctx_t context;
         void *stack;
+        uthread_func_t func;    /* Entry function */
+        bool stack_watched;     /* Whether stack was filled with canaries */
+        uthread_t tid;
+        uint64_t state_since;   /* Time of last change of state */
+        const char *wait;       /* Kind of object blocked on */
+        const void *wait_obj;
+#ifdef UTHREAD_STATS
+        struct uthread_stats stats;
+#endif
 } uthread_tcb;
 
+/* Thread running the idle loop of uthread_run() */
+static struct uthread_tcb *idle_thread;
+
+static uthread_t next_tid;
+
+#ifdef UTHREAD_STATS
+/* Registry of all the threads which haven't exited yet, idle thread included,
+ * to look up statistics by identifier */
+static queue_t all_q;
+
+/* Statistics of the threads which already exited */
+static struct uthread_stats exited_stats;
+
+/* Add @ns spent in @state to @stats */
+static void uthread_stats_add_time(struct uthread_stats *stats, int state,
+                                   uint64_t ns)
+{
+        if (state == T_RUN) {
+                stats->cpu_ns += ns;
+        } else if (state == T_READY) {
+                stats->ready_ns += ns;
+        } else if (state == T_BLOCK) {
+                stats->blocked_ns += ns;
+        }
+}
+
+static void uthread_stats_add(struct uthread_stats *sum,
+                              const struct uthread_stats *stats)
+{
+        sum->voluntary_switches += stats->voluntary_switches;
+        sum->preempted_switches += stats->preempted_switches;
+        sum->cpu_ns += stats->cpu_ns;
+        sum->ready_ns += stats->ready_ns;
+        sum->blocked_ns += stats->blocked_ns;
+        sum->sem_waits += stats->sem_waits;
+}
+
+/* Statistics of @uthread, including the time spent in its current state */
+static void uthread_stats_snapshot(struct uthread_tcb *uthread,
+                                   struct uthread_stats *stats)
+{
+        *stats = uthread->stats;
+        uthread_stats_add_time(stats, uthread->state,
+                               timer_now() - uthread->state_since);
+}
+
+void uthread_stats_sem_wait(void)
+{
+        running_thread->stats.sem_waits++;
+}
+#endif
+
+/*
+ * uthread_set_state - Change state of thread
+ *
+ * With statistics enabled, the time spent in the previous state is accounted
+ * for, and the scheduler latency histograms are updated on switches in and out
+ * of the CPU. Otherwise, the change is only timed while dumps are enabled.
+ */
+static void uthread_set_state(struct uthread_tcb *uthread, int state)
+{
+#ifdef UTHREAD_STATS
+        uint64_t now = timer_now();
+        uint64_t ns = now - uthread->state_since;
+
+        uthread_stats_add_time(&uthread->stats, uthread->state, ns);
+        uthread->state_since = now;
+        if (uthread != idle_thread) {
+                if (uthread->state == T_READY && state == T_RUN) {
+                        latency_ready_delay(ns);
+                } else if (uthread->state == T_RUN) {
+                        latency_slice(ns);
+                }
+        }
+#else
+        if (dump_timed) {
+                uthread->state_since = timer_now();
+        }
+#endif
+        uthread->state = state;
+}
+
+/* Count switch of running thread out of the CPU */
+static void uthread_count_switch(bool preempted)
+{
+#ifdef UTHREAD_STATS
+        if (preempted) {
+                running_thread->stats.preempted_switches++;
+        } else {
+                running_thread->stats.voluntary_switches++;
+        }
+#else
+        (void)preempted;
+#endif
+}
+
+/* Initialize new thread, and add it to the registry if there is one */
+static void uthread_tcb_init(struct uthread_tcb *uthread, int state)
+{
+        uthread->state = state;
+        uthread->tid = next_tid++;
+        /* Same as in uthread_set_state(), untimed states are reported as
+         * lasting since timing started */
+#ifdef UTHREAD_STATS
+        uthread->state_since = timer_now();
+#else
+        uthread->state_since = dump_timed ? timer_now() : 0;
+#endif
+        uthread->wait = NULL;
+#ifdef UTHREAD_STATS
+        memset(&uthread->stats, 0, sizeof(uthread->stats));
+        queue_enqueue(all_q, uthread);
+#endif
+}
+
+/*
+ * uthread_others_ready - Whether threads other than the running one can run
+ *
+ * The idle thread only counts if it has work to do: blocked threads to wake up
+ * with timers, or requests from other OS threads to process.
+ */
+static bool uthread_others_ready(void)
+{
+        if (idle_thread->state == T_READY && queue_length(blocked_q) == 0 &&
+            !external_pending()) {
+                return queue_length(ready_q) > 1;
+        }
+
+        return queue_length(ready_q) > 0;
+}
+
 struct uthread_tcb *uthread_current(void)
 {
         /* Phase 2/3 */
         return running_thread;
 }
 
-void uthread_yield(void)
+int uthread_set_quantum(unsigned long quantum_us)
+{
+        if (quantum_us == 0) {
+                return -1;
+        }
+
+        return preempt_set_quantum(quantum_us);
+}
+
+/*
+ * uthread_switch_out - Yield execution
+ * @preempted: Whether the running thread is preempted, rather than yielding
+ *	on its own
+ */
+static void uthread_switch_out(bool preempted)
 {
         /* Phase 2 */
         preempt_disable();
 
-        uthread_tcb *next_thread = (uthread_tcb *) malloc(sizeof(uthread_tcb));
+        uthread_tcb *next_thread;
 
         /* Dequeue oldest thread in ready queue and set it to be the newly running thread */
-        queue_dequeue(ready_q, (void **) &next_thread);
-        running_thread->state = T_READY;
+        if (queue_dequeue(ready_q, (void **) &next_thread) == -1) {
+                /* Nothing else to run */
+                preempt_slice_start(false);
+                preempt_enable();
+                return;
+        }
+        uthread_count_switch(preempted);
+        if (!preempted) {
+                trace_record(TRACE_YIELD, running_thread->tid, 0);
+        }
+        replay_switch(preempted ? REPLAY_PREEMPT : REPLAY_YIELD,
+                      next_thread->tid);
+        uthread_set_state(running_thread, T_READY);
         queue_enqueue(ready_q, running_thread);
 
         /* Temporarily store pointer to last running thread */
-        uthread_tcb *prev_thread = (uthread_tcb *) malloc(sizeof(uthread_tcb));
-        prev_thread = running_thread;
+        uthread_tcb *prev_thread = running_thread;
 
         /* Change running thread */
-        next_thread->state = T_RUN;
+        uthread_set_state(next_thread, T_RUN);
         running_thread = next_thread;
+        trace_record(TRACE_RUN, next_thread->tid, 0);
+        preempt_slice_start(uthread_others_ready());
         
         preempt_enable();
         
         uthread_ctx_switch(& prev_thread->context, & running_thread->context);
 }
 
+void uthread_yield(void)
+{
+        uthread_switch_out(false);
+}
+
+void uthread_preempt(void)
+{
+        uthread_switch_out(true);
+}
+
 void uthread_exit(void)
 {
         /* Phase 2 */
         preempt_disable();
-        uthread_tcb *next_thread = (uthread_tcb *) malloc(sizeof(uthread_tcb));
-        uthread_tcb *prev_thread = (uthread_tcb *) malloc(sizeof(uthread_tcb));
+        uthread_tcb *next_thread, *prev_thread;
 
         /* Dequeue oldest thread in ready queue */
         queue_dequeue(ready_q, (void **) &next_thread);
 
         /* Store pointer to last running thread and set to exit state */
         prev_thread = running_thread;
-        prev_thread->state = T_EXIT;
+        trace_record(TRACE_EXIT, prev_thread->tid, 0);
+        replay_switch(REPLAY_EXIT, next_thread->tid);
+        uthread_set_state(prev_thread, T_EXIT);
+#ifdef UTHREAD_STATS
+        queue_delete(all_q, prev_thread);
+        uthread_stats_add(&exited_stats, &prev_thread->stats);
+#endif
         queue_enqueue(exited_q, prev_thread);
 
         /* Set new running thread */
-        next_thread->state = T_RUN;
+        uthread_set_state(next_thread, T_RUN);
         running_thread = next_thread;
+        trace_record(TRACE_RUN, next_thread->tid, 0);
+        preempt_slice_start(uthread_others_ready());
         
         preempt_enable();
 
@@ -92,6 +276,8 @@ int uthread_create(uthread_func_t func, void *arg)
         /* Allocate space for new thread and its members */
         uthread_tcb *new_thread = (uthread_tcb *) malloc(sizeof(uthread_tcb));
         new_thread->stack = uthread_ctx_alloc_stack();
+        new_thread->func = func;
+        new_thread->stack_watched = stack_watched;
 
         if (new_thread == NULL || new_thread->stack == NULL) {
                 return -1;
@@ -102,8 +288,10 @@ int uthread_create(uthread_func_t func, void *arg)
                 return -1;
         }
 
-        new_thread->state = T_READY;
+        uthread_tcb_init(new_thread, T_READY);
+        trace_record(TRACE_CREATE, running_thread->tid, new_thread->tid);
         queue_enqueue(ready_q, new_thread);
+        preempt_ready();
 
         preempt_enable();
         
@@ -114,40 +302,98 @@ void uthread_destroy(void)
 {
         preempt_disable();
         
-        uthread_tcb *thread = (uthread_tcb *) malloc(sizeof(uthread_tcb));
-
-        while (queue_length(exited_q) > 0) {
-                queue_dequeue(exited_q, (void **) &thread);
-                if(thread->stack) {
-                        uthread_ctx_destroy_stack(thread->stack);
+        void *exited[16];
+        int i, n;
+
+        /* Drain exited threads by batches */
+        while ((n = queue_dequeue_bulk(exited_q, exited, 16)) > 0) {
+                for (i = 0; i < n; i++) {
+                        uthread_tcb *thread = exited[i];
+
+                        if(thread->stack) {
+                                if (thread->stack_watched) {
+                                        stack_record(thread->func,
+                                                     uthread_ctx_stack_used(thread->stack));
+                                }
+                                uthread_ctx_destroy_stack(thread->stack);
+                        }
+                        free(thread);
                 }
-                free(thread);
         }
         
         preempt_enable();
 }
 
 int uthread_run(bool preempt, uthread_func_t func, void *arg)
+{
+        struct uthread_run_opts opts = {
+                .preempt = preempt,
+                .quantum_us = UTHREAD_QUANTUM_DEFAULT,
+                .clock = UTHREAD_CLOCK_VIRTUAL,
+        };
+
+        return uthread_run_ex(&opts, func, arg);
+}
+
+int uthread_run_ex(const struct uthread_run_opts *opts, uthread_func_t func, void *arg)
 {
         /* Phase 2 */
+        bool preempt = opts ? opts->preempt : false;
+        unsigned long quantum_us = UTHREAD_QUANTUM_DEFAULT;
+        int clock = UTHREAD_CLOCK_VIRTUAL;
+        uint64_t seed = 0;
+
+        if (opts) {
+                if (opts->quantum_us) {
+                        quantum_us = opts->quantum_us;
+                }
+                clock = opts->clock;
+                seed = opts->seed;
+        }
+        if (clock != UTHREAD_CLOCK_VIRTUAL && clock != UTHREAD_CLOCK_PROF &&
+            clock != UTHREAD_CLOCK_MONOTONIC && clock != UTHREAD_CLOCK_TICKS) {
+                return -1;
+        }
         
         /* Start preemption while uthread library is initializing */
-        preempt_start(preempt);
+        preempt_start(preempt, clock, quantum_us, seed);
         
         /* Create state queues */
         ready_q = queue_create();
-        blocked_q = queue_create();
+        /* Threads are unblocked in any order: delete them in O(1) */
+        blocked_q = queue_create_indexed();
         exited_q = queue_create();
+        next_tid = 0;
+#ifdef UTHREAD_STATS
+        /* Threads exit in any order: delete them in O(1) */
+        all_q = queue_create_indexed();
+        memset(&exited_stats, 0, sizeof(exited_stats));
+#endif
+
+        /* Accept requests from other OS threads */
+        if (external_start() == -1) {
+                queue_destroy(ready_q);
+                queue_destroy(blocked_q);
+                queue_destroy(exited_q);
+#ifdef UTHREAD_STATS
+                queue_destroy(all_q);
+                all_q = NULL;
+#endif
+                preempt_stop();
+                return -1;
+        }
 
         /* 1. REGISTER IDLE THREAD */
-        uthread_tcb *idle_thread = (uthread_tcb *) malloc(sizeof(uthread_tcb));
-        idle_thread->state = T_RUN;
-
-        /* Allocate memory for the running thread global variable */
-        running_thread = (uthread_tcb *) malloc(sizeof(uthread_tcb));
+        idle_thread = (uthread_tcb *) malloc(sizeof(uthread_tcb));
+        /* Runs on the stack of the process */
+        idle_thread->stack = NULL;
+        idle_thread->func = NULL;
+        idle_thread->stack_watched = false;
+        uthread_tcb_init(idle_thread, T_RUN);
 
         /* Set running thread to idle thread */
         running_thread = idle_thread;
+        trace_record(TRACE_RUN, idle_thread->tid, 0);
 
         /* 2. CREATE INITIAL THREAD */
         uthread_create(func, arg);
@@ -155,34 +401,61 @@ int uthread_run(bool preempt, uthread_func_t func, void *arg)
         /* Enable preemption */
         preempt_enable();
 
-        /* 3. EXECUTE INFINITE LOOP WHILE READY QUEUE IS NOT EMPTY */
+        /* 3. EXECUTE INFINITE LOOP UNTIL ALL THREADS ARE DONE */
         while (1) {
                 /* Destroy threads and their associated TCB's in exited queue */
                 if (queue_length(exited_q) > 0) {
                         uthread_destroy();
                 }
-                /* Stop idle loop and return if no more threads to execute
-                 * otherwise, yield to next available thread if preempt is false 
-                 * */
-                if (queue_length(ready_q) == 0) {
-                        return 0;
-                } else {
-                        if (!preempt) {
-                                uthread_yield();
-                        }
+                /* Fire expired timers and process requests from other OS
+                 * threads, which may make threads ready again */
+                timer_run();
+                external_run();
+
+                /* Yield to next available thread, rather than waiting to be
+                 * preempted */
+                if (queue_length(ready_q) > 0) {
+                        uthread_yield();
+                        continue;
+                }
+
+                /* Stop idle loop if no more threads to execute, or if
+                 * nothing can unblock them anymore, otherwise sleep until a
+                 * timer expires or another OS thread posts a request that
+                 * may unblock a thread */
+                if (queue_length(blocked_q) == 0) {
+                        break;
+                }
+                uint64_t deadline = 0;
+                if (timer_next(&deadline) == -1 && !external_expected()) {
+                        break;
+                }
+                /* A replayed run fires timers when the recorded one did */
+                if (!replay_wake()) {
+                        external_wait(deadline);
                 }
         }
-        
+        uthread_destroy();
+        external_stop();
+
         preempt_disable();
+        trace_record(TRACE_EXIT, idle_thread->tid, 0);
+        latency_stop();
         
         /* Free memory allocated for queues */
         queue_destroy(ready_q);
         queue_destroy(blocked_q);
         queue_destroy(exited_q);
+#ifdef UTHREAD_STATS
+        queue_delete(all_q, idle_thread);
+        queue_destroy(all_q);
+        all_q = NULL;
+#endif
+        running_thread = NULL;
+        free(idle_thread);
         
-        if (preempt) {
-                preempt_stop();
-        }
+        /* Also stops counting ticks, whether preemption was enabled or not */
+        preempt_stop();
 
         return 0;
 }
@@ -193,21 +466,25 @@ void uthread_block(void)
         /* Disable preemption when entering critical section */
         preempt_disable();
 
-        uthread_tcb *next_thread = (uthread_tcb *) malloc(sizeof(uthread_tcb));
+        uthread_tcb *next_thread;
 
         /* Dequeue oldest thread in ready queue and set it to be the newly running thread */
         queue_dequeue(ready_q, (void **) &next_thread);
         /* Change the state of the currently running thread to blocked */
-        running_thread->state = T_BLOCK;
+        uthread_count_switch(false);
+        trace_record(TRACE_BLOCK, running_thread->tid, 0);
+        replay_switch(REPLAY_BLOCK, next_thread->tid);
+        uthread_set_state(running_thread, T_BLOCK);
         queue_enqueue(blocked_q, running_thread);
 
         /* Temporarily store pointer to blocked thread */
-        uthread_tcb *blocked_thread = (uthread_tcb *) malloc(sizeof(uthread_tcb));
-        blocked_thread = running_thread;
+        uthread_tcb *blocked_thread = running_thread;
 
         /* Change running thread */
-        next_thread->state = T_RUN;
+        uthread_set_state(next_thread, T_RUN);
         running_thread = next_thread;
+        trace_record(TRACE_RUN, next_thread->tid, 0);
+        preempt_slice_start(uthread_others_ready());
 
         uthread_ctx_switch(& blocked_thread->context, & running_thread->context);
 
@@ -215,17 +492,223 @@ void uthread_block(void)
 }
 
 
+bool uthread_idle(void)
+{
+        return running_thread == NULL || running_thread == idle_thread;
+}
+
+void uthread_set_wait(const char *what, const void *obj)
+{
+        running_thread->wait = what;
+        running_thread->wait_obj = obj;
+}
+
+void uthread_ready(struct uthread_tcb *uthread)
+{
+        /* Change uthread state to ready */
+        trace_record(TRACE_UNBLOCK, uthread->tid, running_thread->tid);
+        uthread_set_state(uthread, T_READY);
+        queue_delete(blocked_q, uthread);
+
+        /* Enqueue uthread back into the ready queue */
+        queue_enqueue(ready_q, uthread);
+        preempt_ready();
+}
+
 void uthread_unblock(struct uthread_tcb *uthread)
 {
         /* Phase 3 */
         /* Disable preemption when entering critical section */
         preempt_disable();
+        uthread_ready(uthread);
+        preempt_enable();
+}
 
-        /* Change uthread state to ready */
-        uthread->state = T_READY;
+/* Mark waiter as ready, before it gets moved to the ready queue */
+static void uthread_mark_ready(queue_t queue, void *data)
+{
+        struct uthread_tcb *uthread = data;
+
+        (void)queue;
+        trace_record(TRACE_UNBLOCK, uthread->tid, running_thread->tid);
+        uthread_set_state(uthread, T_READY);
         queue_delete(blocked_q, uthread);
+}
 
-        /* Enqueue uthread back into the ready queue */
-        queue_enqueue(ready_q, uthread);
+void uthread_unblock_all(queue_t queue)
+{
+        /* Disable preemption once for the whole batch */
+        preempt_disable();
+
+        /* Move every waiter from @queue to the ready queue at once, oldest
+         * first */
+        if (queue_length(queue) > 0) {
+                queue_iterate(queue, uthread_mark_ready);
+                queue_splice(ready_q, queue);
+                preempt_ready();
+        }
+        preempt_enable();
+}
+
+void uthread_switch_to(struct uthread_tcb *uthread)
+{
+        /* Disable preemption when entering critical section */
+        preempt_disable();
+
+        /* Take @uthread out of the blocked queue without going through the
+         * ready queue */
+        queue_delete(blocked_q, uthread);
+        trace_record(TRACE_UNBLOCK, uthread->tid, running_thread->tid);
+
+        /* Current thread becomes the newest ready thread */
+        uthread_tcb *prev_thread = running_thread;
+        uthread_count_switch(false);
+        trace_record(TRACE_YIELD, prev_thread->tid, 0);
+        replay_switch(REPLAY_YIELD, uthread->tid);
+        uthread_set_state(prev_thread, T_READY);
+        queue_enqueue(ready_q, prev_thread);
+
+        /* Change running thread */
+        uthread_set_state(uthread, T_RUN);
+        running_thread = uthread;
+        trace_record(TRACE_RUN, uthread->tid, 0);
+        preempt_slice_start(uthread_others_ready());
+
+        uthread_ctx_switch(& prev_thread->context, & running_thread->context);
+
+        preempt_enable();
+}
+
+uthread_t uthread_self(void)
+{
+        return running_thread->tid;
+}
+
+#ifdef UTHREAD_STATS
+/* Identifier of thread looked up by uthread_stats() */
+static uthread_t lookup_tid;
+
+static int uthread_match_tid(queue_t queue, void *data)
+{
+        struct uthread_tcb *uthread = data;
+
+        (void)queue;
+        return uthread->tid == lookup_tid;
+}
+
+/* Sum of statistics computed by uthread_runtime_stats() */
+static struct uthread_stats *stats_sum;
+
+static void uthread_sum_stats(queue_t queue, void *data)
+{
+        struct uthread_tcb *uthread = data;
+        struct uthread_stats stats;
+
+        (void)queue;
+        if (uthread != idle_thread) {
+                uthread_stats_snapshot(uthread, &stats);
+                uthread_stats_add(stats_sum, &stats);
+        }
+}
+#endif
+
+int uthread_stats(uthread_t tid, struct uthread_stats *stats)
+{
+#ifdef UTHREAD_STATS
+        void *data;
+
+        if (stats == NULL || all_q == NULL) {
+                return -1;
+        }
+
+        preempt_disable();
+        lookup_tid = tid;
+        if (queue_iterate_until(all_q, uthread_match_tid, &data) != 1) {
+                preempt_enable();
+                return -1;
+        }
+        uthread_stats_snapshot(data, stats);
+        preempt_enable();
+
+        return 0;
+#else
+        (void)tid;
+        (void)stats;
+        return -1;
+#endif
+}
+
+int uthread_runtime_stats(struct uthread_stats *stats)
+{
+#ifdef UTHREAD_STATS
+        if (stats == NULL || all_q == NULL) {
+                return -1;
+        }
+
+        preempt_disable();
+        *stats = exited_stats;
+        stats_sum = stats;
+        queue_iterate(all_q, uthread_sum_stats);
         preempt_enable();
+
+        return 0;
+#else
+        (void)stats;
+        return -1;
+#endif
+}
+
+int uthread_stack_bounds(uintptr_t *lo, uintptr_t *hi)
+{
+        if (running_thread == NULL || running_thread->stack == NULL) {
+                return -1;
+        }
+        *lo = (uintptr_t) running_thread->stack;
+        *hi = *lo + UTHREAD_STACK_SIZE;
+
+        return 0;
+}
+
+/* Function called by uthread_inspect() on each thread */
+static void (*inspect_func)(const struct uthread_info *info);
+
+static void uthread_inspect_one(queue_t queue, void *data)
+{
+        struct uthread_tcb *uthread = data;
+        struct uthread_info info = {
+                .tid = uthread->tid,
+                .state = "ready",
+                .state_since = uthread->state_since,
+                .context = &uthread->context,
+        };
+
+        (void)queue;
+        if (uthread == running_thread) {
+                info.state = "running";
+                info.context = NULL;
+        } else if (uthread->state == T_BLOCK) {
+                info.state = "blocked";
+                info.wait = uthread->wait;
+                info.wait_obj = uthread->wait_obj;
+        }
+        if (uthread->stack) {
+                info.stack_lo = (uintptr_t) uthread->stack;
+                info.stack_hi = info.stack_lo + UTHREAD_STACK_SIZE;
+        }
+        inspect_func(&info);
+}
+
+int uthread_inspect(void (*func)(const struct uthread_info *info))
+{
+        if (running_thread == NULL) {
+                return -1;
+        }
+
+        /* Live threads are either running, ready or blocked */
+        inspect_func = func;
+        uthread_inspect_one(NULL, running_thread);
+        queue_iterate(ready_q, uthread_inspect_one);
+        queue_iterate(blocked_q, uthread_inspect_one);
+
+        return 0;
 }
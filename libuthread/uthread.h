@@ -2,6 +2,7 @@
 #define _UTHREAD_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /*
  * uthread_func_t - Thread function type
@@ -19,6 +20,13 @@ typedef void (*uthread_func_t)(void *arg);
  * thread. It starts the multithreading scheduling library, and becomes the
  * "idle" thread. It returns once all the threads have finished running.
  *
+ * While all the remaining threads are blocked, the idle thread sleeps until a
+ * timeout expires or until another OS thread posts a request that may unblock
+ * one of them (see uthread_post_external() and sem_up_external()). If no
+ * timeout is pending and no OS thread is attached with
+ * uthread_external_attach(), the remaining threads can't be unblocked anymore
+ * and the function returns.
+ *
  * If @preempt is `true`, then preemptive scheduling is enabled.
  *
  * Return: 0 in case of success, -1 in case of failure (e.g., memory allocation,
@@ -26,6 +34,73 @@ typedef void (*uthread_func_t)(void *arg);
  */
 int uthread_run(bool preempt, uthread_func_t func, void *arg);
 
+/*
+ * Clocks measuring preemption time slices
+ *
+ * UTHREAD_CLOCK_VIRTUAL: CPU time spent by the process in user mode
+ * UTHREAD_CLOCK_PROF: CPU time spent by the process, in user and kernel mode
+ * UTHREAD_CLOCK_MONOTONIC: Wall-clock time, which also elapses while a thread
+ *	sleeps in a blocking system call
+ * UTHREAD_CLOCK_TICKS: Deterministic virtual clock, which ticks each time a
+ *	thread enters the library (e.g., creates a thread or takes a semaphore).
+ *	Time slices are then counted in ticks rather than microseconds, so that
+ *	threads are preempted at the same points from one run to the next
+ */
+#define UTHREAD_CLOCK_VIRTUAL	0
+#define UTHREAD_CLOCK_PROF	1
+#define UTHREAD_CLOCK_MONOTONIC	2
+#define UTHREAD_CLOCK_TICKS	3
+
+/* Default length of a time slice, in microseconds (100 Hz) */
+#define UTHREAD_QUANTUM_DEFAULT	10000
+
+/*
+ * struct uthread_run_opts - Options of uthread_run_ex()
+ * @preempt: Preemption enable
+ * @quantum_us: Length of a time slice in microseconds, or in ticks with
+ *	UTHREAD_CLOCK_TICKS, 0 for UTHREAD_QUANTUM_DEFAULT
+ * @clock: Clock measuring time slices, one of the UTHREAD_CLOCK_* values
+ * @seed: With UTHREAD_CLOCK_TICKS, seed of the pseudo-random generator drawing
+ *	the length of each slice between 1 and @quantum_us ticks. 0 for slices
+ *	of exactly @quantum_us ticks
+ */
+struct uthread_run_opts {
+	bool preempt;
+	unsigned long quantum_us;
+	int clock;
+	uint64_t seed;
+};
+
+/*
+ * uthread_run_ex - Run the multithreading library with options
+ * @opts: Options, or NULL for the same defaults as uthread_run() without
+ *	preemption
+ * @func: Function of the first thread to start
+ * @arg: Argument to be passed to the first thread
+ *
+ * Same as uthread_run(), with preemption configured by @opts. uthread_run()
+ * uses UTHREAD_QUANTUM_DEFAULT and UTHREAD_CLOCK_VIRTUAL.
+ *
+ * Return: 0 in case of success, -1 if @opts->clock is invalid or in case of
+ * failure (e.g., memory allocation, context creation).
+ */
+int uthread_run_ex(const struct uthread_run_opts *opts, uthread_func_t func,
+		   void *arg);
+
+/*
+ * uthread_set_quantum - Change length of time slices
+ * @quantum_us: New length of a time slice, in microseconds, or in ticks with
+ *	UTHREAD_CLOCK_TICKS
+ *
+ * Can be called by any thread while the library runs with preemption enabled.
+ * The current time slice is restarted with the new length, except with
+ * UTHREAD_CLOCK_TICKS where the new length applies from the next slice.
+ *
+ * Return: -1 if @quantum_us is 0, if preemption is not enabled, or in case of
+ * failure when rearming the timer. 0 otherwise.
+ */
+int uthread_set_quantum(unsigned long quantum_us);
+
 /*
  * uthread_create - Create a new thread
  * @func: Function to be executed by the thread
@@ -39,6 +114,38 @@ int uthread_run(bool preempt, uthread_func_t func, void *arg);
  */
 int uthread_create(uthread_func_t func, void *arg);
 
+/*
+ * uthread_post_external - Create a new thread from another OS thread
+ * @func: Function to be executed by the thread
+ * @arg: Argument to be passed to the thread
+ *
+ * This function can safely be called from any OS thread of the process, for
+ * instance from a pthread, while the library is running. The new thread is
+ * created asynchronously, the next time the library is idle.
+ *
+ * Return: 0 in case of success, -1 in case of failure (e.g., memory allocation,
+ * library not running).
+ */
+int uthread_post_external(uthread_func_t func, void *arg);
+
+/*
+ * uthread_external_attach - Announce requests from another OS thread
+ *
+ * Keep the library waiting for requests while all its threads are blocked,
+ * until a matching call to uthread_external_detach(). Attach before the OS
+ * thread is started, for instance from the thread of the library that starts
+ * it, so that the library can't return in between. Can be called from any
+ * OS thread.
+ */
+void uthread_external_attach(void);
+
+/*
+ * uthread_external_detach - Withdraw announce of uthread_external_attach()
+ *
+ * Typically called by the OS thread once it has posted its last request.
+ */
+void uthread_external_detach(void);
+
 /*
  * uthread_yield - Yield execution
  *
@@ -57,4 +164,67 @@ void uthread_yield(void);
  */
 void uthread_exit(void);
 
+/*
+ * uthread_t - Thread identifier
+ *
+ * Threads are numbered from 1 in order of creation, within a run of the
+ * library. The idle thread is numbered 0.
+ */
+typedef unsigned long uthread_t;
+
+/*
+ * uthread_self - Get identifier of currently running thread
+ *
+ * Return: Identifier of the calling thread
+ */
+uthread_t uthread_self(void);
+
+/*
+ * struct uthread_stats - Runtime statistics of a thread
+ * @voluntary_switches: Number of times the thread yielded or blocked
+ * @preempted_switches: Number of times the thread was preempted
+ * @cpu_ns: Time spent running, in nanoseconds
+ * @ready_ns: Time spent ready but waiting for its turn, in nanoseconds
+ * @blocked_ns: Time spent blocked, in nanoseconds
+ * @sem_waits: Number of times the thread blocked on a semaphore
+ *
+ * Times are measured with the monotonic clock at each change of state, so
+ * that the running time of a thread includes the time the process itself is
+ * descheduled by the OS.
+ */
+struct uthread_stats {
+	unsigned long voluntary_switches;
+	unsigned long preempted_switches;
+	uint64_t cpu_ns;
+	uint64_t ready_ns;
+	uint64_t blocked_ns;
+	unsigned long sem_waits;
+};
+
+/*
+ * uthread_stats - Get runtime statistics of a thread
+ * @tid: Identifier of a thread which hasn't exited yet
+ * @stats: Address where to store the statistics of @tid
+ *
+ * Statistics are only collected if the library was built with UTHREAD_STATS
+ * defined (`make STATS=1`); otherwise switches pay nothing for them.
+ *
+ * Return: -1 if statistics are not collected, if @stats is NULL or if no
+ * thread @tid is running. 0 otherwise.
+ */
+int uthread_stats(uthread_t tid, struct uthread_stats *stats);
+
+/*
+ * uthread_runtime_stats - Get runtime statistics of all the threads
+ * @stats: Address where to store the statistics
+ *
+ * The statistics of all the threads created since uthread_run() was called,
+ * including the ones which already exited but excluding the idle thread, are
+ * summed up.
+ *
+ * Return: -1 if statistics are not collected, if @stats is NULL or if the
+ * library is not running. 0 otherwise.
+ */
+int uthread_runtime_stats(struct uthread_stats *stats);
+
 #endif /* _THREAD_H */